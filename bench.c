@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <time.h>
+#include "myalloc.h"
+#include "trace.h"
+
+/*
+ * Benchmark harness, run through `make bench`.
+ *
+ * Every workload is run once against myalloc and once against the system's malloc, each
+ * in a process of its own, so that peak RSS is that of the one run. A row is printed per
+ * run with the throughput, the latency percentiles of single calls, the peak RSS and the
+ * fragmentation: the share of the memory the allocator holds for the heap that is free,
+ * taken while the workload's objects are still live.
+ *
+ * usage: benchmark [-t threads] [-n operations] [-r trace] [workload ...]
+ *
+ * -n is the number of operations per thread, -t overrides every workload's thread count.
+ * Without workloads named, all of them are run; a trace given with -r adds "replay".
+ * myalloc's environment variables apply as usual, so placement policies are compared
+ * by running the benchmark once with each MYALLOC_POLICY.
+ *
+ * Traces are those recorded with MYALLOC_TRACE, see trace.h, read back with trace_read as
+ * the replay tool reads them, and replayed on a single thread.
+ */
+
+//operations per thread, unless -n says otherwise
+#define DEFAULT_OPERATIONS 1000000
+//one in this many calls is timed, timing every call would cost more than most calls
+#define SAMPLE_EVERY 8
+//latencies below this many nanoseconds get a histogram bucket each
+#define LINEAR_BUCKETS 64
+//above that each power of two is split into this many buckets
+#define SUB_BUCKETS 16
+#define BUCKETS (LINEAR_BUCKETS + 40 * SUB_BUCKETS)
+
+/*--- ALLOCATORS ---*/
+
+typedef struct allocator {
+    const char *name;
+    void *(*alloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    //only used replaying traces, which record them
+    void *(*calloc)(size_t count, size_t size);
+    void *(*aligned_alloc)(size_t alignment, size_t size);
+} allocator;
+
+static allocator ALLOCATORS[] = {
+    {"myalloc", myalloc, myfree, myrealloc, mycalloc, myaligned_alloc},
+    {"glibc", malloc, free, realloc, calloc, aligned_alloc},
+};
+
+/*--- MEASUREMENT ---*/
+
+//the state of one thread of a workload, which its objects are left in when it is done
+typedef struct context {
+    allocator *allocator;
+    unsigned long operations;
+    unsigned int seed;
+    //objects still live when the workload is done, freed after fragmentation is measured
+    void **slots;
+    size_t slotCount;
+    //the thread's share of a producer/consumer pair
+    struct ring *ring;
+    //number of calls made, and a histogram of the latencies of those timed
+    unsigned long calls;
+    unsigned long histogram[BUCKETS];
+} context;
+
+//return the time of the monotonic clock in nanoseconds
+static unsigned long now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000UL + time.tv_nsec;
+}
+
+//return the histogram bucket a latency falls in
+static int bucket(unsigned long ns) {
+    if (ns < LINEAR_BUCKETS)
+        return ns;
+    int exponent = 63 - __builtin_clzl(ns);
+    int index = LINEAR_BUCKETS + (exponent - 6) * SUB_BUCKETS + ((ns >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+//return the smallest latency falling in a histogram bucket
+static unsigned long bucket_floor(int index) {
+    if (index < LINEAR_BUCKETS)
+        return index;
+    int exponent = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 6;
+    unsigned long sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+    return (1UL << exponent) + (sub << (exponent - 4));
+}
+
+//return the latency the given fraction of the histogram's samples are at or below
+static unsigned long percentile(unsigned long *histogram, double fraction) {
+    unsigned long total = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        total += histogram[i];
+    unsigned long target = total * fraction;
+    unsigned long seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > target)
+            return bucket_floor(i);
+    }
+    return 0;
+}
+
+//make the allocator's calls on behalf of a workload, timing one in SAMPLE_EVERY of them;
+//allocated memory is touched, as a program would
+static void *bench_alloc(context *ctx, size_t size) {
+    if (ctx->calls++ % SAMPLE_EVERY != 0) {
+        char *ptr = ctx->allocator->alloc(size);
+        *ptr = 1;
+        return ptr;
+    }
+    unsigned long start = now_ns();
+    char *ptr = ctx->allocator->alloc(size);
+    ctx->histogram[bucket(now_ns() - start)]++;
+    *ptr = 1;
+    return ptr;
+}
+
+static void bench_free(context *ctx, void *ptr) {
+    if (ctx->calls++ % SAMPLE_EVERY != 0) {
+        ctx->allocator->free(ptr);
+        return;
+    }
+    unsigned long start = now_ns();
+    ctx->allocator->free(ptr);
+    ctx->histogram[bucket(now_ns() - start)]++;
+}
+
+static void *bench_realloc(context *ctx, void *ptr, size_t size) {
+    if (ctx->calls++ % SAMPLE_EVERY != 0)
+        return ctx->allocator->realloc(ptr, size);
+    unsigned long start = now_ns();
+    ptr = ctx->allocator->realloc(ptr, size);
+    ctx->histogram[bucket(now_ns() - start)]++;
+    return ptr;
+}
+
+static void *bench_calloc(context *ctx, size_t size) {
+    if (ctx->calls++ % SAMPLE_EVERY != 0)
+        return ctx->allocator->calloc(size, 1);
+    unsigned long start = now_ns();
+    void *ptr = ctx->allocator->calloc(size, 1);
+    ctx->histogram[bucket(now_ns() - start)]++;
+    return ptr;
+}
+
+static void *bench_aligned_alloc(context *ctx, size_t alignment, size_t size) {
+    if (ctx->calls++ % SAMPLE_EVERY != 0)
+        return ctx->allocator->aligned_alloc(alignment, size);
+    unsigned long start = now_ns();
+    void *ptr = ctx->allocator->aligned_alloc(alignment, size);
+    ctx->histogram[bucket(now_ns() - start)]++;
+    return ptr;
+}
+
+//return the share of the memory held for the heap that is free
+static double fragmentation(allocator *allocator) {
+    if (allocator->alloc == myalloc) {
+        struct myalloc_stats stats;
+        myalloc_stats(&stats);
+        return stats.free == 0 ? 0 : (double)stats.free / (stats.free + stats.in_use);
+    }
+    struct mallinfo2 info = mallinfo2();
+    size_t held = info.arena + info.hblkhd;
+    return held == 0 ? 0 : (double)info.fordblks / held;
+}
+
+//return a slot array for a context, mapped directly so it costs neither allocator anything
+static void **slots_create(context *ctx, size_t count) {
+    ctx->slots = mmap(NULL, count * sizeof(void*), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ctx->slotCount = count;
+    return ctx->slots;
+}
+
+/*--- WORKLOADS ---*/
+
+//a size between min and max, skewed towards min as real programs' sizes are
+static size_t random_size(unsigned int *seed, size_t min, size_t max) {
+    size_t range = max - min + 1;
+    size_t a = rand_r(seed) % range;
+    size_t b = rand_r(seed) % range;
+    return min + (a < b ? a : b);
+}
+
+//allocate a batch of equal sized objects and free them again, over and over
+static void *churn(void *arg) {
+    context *ctx = arg;
+    void *batch[100];
+    for (unsigned long done = 0; done < ctx->operations; done += 200) {
+        for (int i = 0; i < 100; i++)
+            batch[i] = bench_alloc(ctx, 64);
+        for (int i = 0; i < 100; i++)
+            bench_free(ctx, batch[i]);
+    }
+    return NULL;
+}
+
+//replace randomly chosen objects of a large live set with objects of random sizes
+static void *random_sizes(void *arg) {
+    context *ctx = arg;
+    void **slots = slots_create(ctx, 10000);
+    for (size_t i = 0; i < ctx->slotCount; i++)
+        slots[i] = bench_alloc(ctx, random_size(&ctx->seed, 8, 4096));
+    for (unsigned long done = 0; done < ctx->operations; done += 2) {
+        size_t i = rand_r(&ctx->seed) % ctx->slotCount;
+        bench_free(ctx, slots[i]);
+        slots[i] = bench_alloc(ctx, random_size(&ctx->seed, 8, 4096));
+    }
+    return NULL;
+}
+
+//a single producer single consumer queue of objects passed between two threads
+typedef struct ring {
+    void *objects[1024];
+    unsigned long head;
+    unsigned long tail;
+} ring;
+
+//allocate objects and pass them to a consumer thread, which frees them
+static void *producer(void *arg) {
+    context *ctx = arg;
+    ring *ring = ctx->ring;
+    for (unsigned long done = 0; done < ctx->operations; done++) {
+        void *object = bench_alloc(ctx, random_size(&ctx->seed, 16, 512));
+        while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == 1024)
+            sched_yield();
+        ring->objects[ring->head % 1024] = object;
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    context *ctx = arg;
+    ring *ring = ctx->ring;
+    for (unsigned long done = 0; done < ctx->operations; done++) {
+        while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail)
+            sched_yield();
+        bench_free(ctx, ring->objects[ring->tail % 1024]);
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+//replace random objects of a thread's live set for a while, then hand the set on to a
+//new thread, which frees what the last one allocated; after the larson benchmark
+static void *larson_epoch(void *arg) {
+    context *ctx = arg;
+    for (unsigned long done = 0; done < ctx->operations / 10; done += 2) {
+        size_t i = rand_r(&ctx->seed) % ctx->slotCount;
+        bench_free(ctx, ctx->slots[i]);
+        ctx->slots[i] = bench_alloc(ctx, random_size(&ctx->seed, 10, 1000));
+    }
+    return NULL;
+}
+
+static void *larson(void *arg) {
+    context *ctx = arg;
+    void **slots = slots_create(ctx, 1000);
+    for (size_t i = 0; i < ctx->slotCount; i++)
+        slots[i] = bench_alloc(ctx, random_size(&ctx->seed, 10, 1000));
+    for (int epoch = 0; epoch < 10; epoch++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, larson_epoch, ctx);
+        pthread_join(thread, NULL);
+    }
+    return NULL;
+}
+
+//mostly small objects with a long tail of large ones, some of them resized, in the
+//manner of mimalloc-bench's alloc-test
+static void *mixed(void *arg) {
+    context *ctx = arg;
+    void **slots = slots_create(ctx, 2000);
+    for (unsigned long done = 0; done < ctx->operations; done++) {
+        size_t i = rand_r(&ctx->seed) % ctx->slotCount;
+        int kind = rand_r(&ctx->seed) % 100;
+        size_t size = kind < 80 ? random_size(&ctx->seed, 16, 256)
+            : kind < 95 ? random_size(&ctx->seed, 256, 16384)
+            : random_size(&ctx->seed, 16384, 1 << 20);
+        if (slots[i] == NULL) {
+            slots[i] = bench_alloc(ctx, size);
+            memset(slots[i], 0, size < 64 ? size : 64);
+        } else if (kind % 10 == 0) {
+            slots[i] = bench_realloc(ctx, slots[i], size);
+        } else {
+            bench_free(ctx, slots[i]);
+            slots[i] = NULL;
+        }
+    }
+    return NULL;
+}
+
+//the trace given with -r, read before the runs are forked
+static trace_ops TRACE;
+
+//replay the trace, as many times as fits the number of operations
+static void *replay(void *arg) {
+    context *ctx = arg;
+    void **slots = slots_create(ctx, TRACE.ids);
+    unsigned long done = 0;
+    do {
+        for (size_t i = 0; i < TRACE.count; i++, done++) {
+            trace_op *op = &TRACE.ops[i];
+            if (op->kind == TRACE_ALLOC) {
+                slots[op->id] = bench_alloc(ctx, op->size);
+            } else if (op->kind == TRACE_CALLOC) {
+                slots[op->id] = bench_calloc(ctx, op->size);
+            } else if (op->kind == TRACE_ALIGNED) {
+                slots[op->id] = bench_aligned_alloc(ctx, op->alignment, op->size);
+            } else if (op->kind == TRACE_REALLOC) {
+                slots[op->id] = bench_realloc(ctx, slots[op->id], op->size);
+            } else {
+                bench_free(ctx, slots[op->id]);
+                slots[op->id] = NULL;
+            }
+        }
+        //whatever the trace left live is freed before it is replayed again
+        if (done < ctx->operations) {
+            for (size_t i = 0; i < ctx->slotCount; i++) {
+                if (slots[i] != NULL)
+                    bench_free(ctx, slots[i]);
+                slots[i] = NULL;
+            }
+        }
+    } while (done < ctx->operations && TRACE.count > 0);
+    return NULL;
+}
+
+typedef struct workload {
+    const char *name;
+    void *(*run)(void *ctx);
+    //threads run by default, producer/consumer runs this many pairs
+    int threads;
+} workload;
+
+static workload WORKLOADS[] = {
+    {"churn", churn, 1},
+    {"random", random_sizes, 1},
+    {"prodcons", producer, 2},
+    {"larson", larson, 4},
+    {"mixed", mixed, 4},
+    {"replay", replay, 1},
+};
+
+/*--- RUNNER ---*/
+
+//run a workload against an allocator in this process and print its row
+static void run(workload *workload, allocator *allocator, int threads, unsigned long operations) {
+    bool pairs = workload->run == producer;
+    int count = pairs ? threads * 2 : threads;
+    context *contexts = mmap(NULL, count * sizeof(context), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring *rings = mmap(NULL, threads * sizeof(ring), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pthread_t thread[count];
+    for (int i = 0; i < count; i++) {
+        contexts[i].allocator = allocator;
+        contexts[i].operations = operations;
+        contexts[i].seed = i + 1;
+        contexts[i].ring = &rings[i % threads];
+    }
+    unsigned long start = now_ns();
+    for (int i = 0; i < count; i++)
+        pthread_create(&thread[i], NULL, pairs && i >= threads ? consumer : workload->run, &contexts[i]);
+    for (int i = 0; i < count; i++)
+        pthread_join(thread[i], NULL);
+    double seconds = (now_ns() - start) / 1e9;
+
+    double fragmented = fragmentation(allocator);
+    unsigned long calls = 0;
+    unsigned long histogram[BUCKETS] = {0};
+    for (int i = 0; i < count; i++) {
+        calls += contexts[i].calls;
+        for (int j = 0; j < BUCKETS; j++)
+            histogram[j] += contexts[i].histogram[j];
+        for (size_t j = 0; j < contexts[i].slotCount; j++) {
+            if (contexts[i].slots[j] != NULL)
+                allocator->free(contexts[i].slots[j]);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%-10s %-8s %7d %12.0f %7lu %7lu %7lu %9ldK %6.1f%%\n", workload->name, allocator->name,
+        count, calls / seconds, percentile(histogram, 0.5), percentile(histogram, 0.99),
+        percentile(histogram, 0.999), usage.ru_maxrss, fragmented * 100);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = 0;
+    unsigned long operations = DEFAULT_OPERATIONS;
+    const char *trace = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:n:r:")) != -1) {
+        if (opt == 't')
+            threads = atoi(optarg);
+        else if (opt == 'n')
+            operations = strtoul(optarg, NULL, 10);
+        else if (opt == 'r')
+            trace = optarg;
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-n operations] [-r trace] [workload ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (trace != NULL && trace_read(trace, &TRACE) != 0) {
+        fprintf(stderr, "%s: cannot read trace %s\n", argv[0], trace);
+        return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (strcmp(argv[i], "replay") == 0 && trace == NULL) {
+            fprintf(stderr, "%s: replay needs a trace, given with -r\n", argv[0]);
+            return 1;
+        }
+    }
+    int workloads = sizeof(WORKLOADS) / sizeof(WORKLOADS[0]);
+    int allocators = sizeof(ALLOCATORS) / sizeof(ALLOCATORS[0]);
+    printf("%-10s %-8s %7s %12s %7s %7s %7s %10s %7s\n", "workload", "alloc", "threads",
+        "calls/s", "p50 ns", "p99 ns", "p999 ns", "peak RSS", "frag");
+    for (int w = 0; w < workloads; w++) {
+        workload *workload = &WORKLOADS[w];
+        bool selected = optind == argc ? workload->run != replay || trace != NULL : false;
+        for (int i = optind; i < argc; i++)
+            selected |= strcmp(argv[i], workload->name) == 0;
+        if (!selected)
+            continue;
+        for (int a = 0; a < allocators; a++) {
+            //a process per run, so that each has a heap, and a peak RSS, of its own
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(workload, &ALLOCATORS[a], threads > 0 ? threads : workload->threads, operations);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                printf("%-10s %-8s failed\n", workload->name, ALLOCATORS[a].name);
+        }
+    }
+    return 0;
+}
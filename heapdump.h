@@ -0,0 +1,67 @@
+#include <stdint.h>
+
+/*	The format of the heap dumps written by myalloc_heap_dump, and read by the heatmap
+	tool. A dump is a heapdump_header followed by a heapdump_heap per heap, each followed
+	by its pages: a heapdump_page, then its map of cells, one byte for every 'cell_size'
+	bytes of the page, padded to a multiple of 8 bytes. */
+
+#define HEAPDUMP_MAGIC "MYHEAPD1"
+
+/*	The kinds of page: a page of headed regions, a slab of equal slots, an empty page
+	kept for reuse, and a chunk of an arena, which is in use as a whole. */
+#define HEAPDUMP_REGIONS 1
+#define HEAPDUMP_SLAB 2
+#define HEAPDUMP_RETAINED 3
+#define HEAPDUMP_ARENA 4
+
+/*	A cell holds the percentage of its bytes in use, rounded up so that a cell with any
+	use at all is not taken for an empty one, or this if its memory is not resident. */
+#define HEAPDUMP_NOT_RESIDENT 0xff
+
+typedef struct heapdump_header {
+	char magic[8];
+	/*	bytes covered by each cell of the page maps, the system's page size */
+	uint64_t cell_size;
+	/*	bytes of regions with mappings of their own, which are not in any page */
+	uint64_t direct;
+	/*	number of heaps dumped */
+	uint32_t heaps;
+	uint32_t unused;
+} heapdump_header;
+
+typedef struct heapdump_heap {
+	/*	position of the heap among the heaps, and the NUMA node its pages are bound to */
+	uint32_t index;
+	uint32_t node;
+	/*	number of pages dumped after this */
+	uint64_t pages;
+	/*	bytes mapped, in regions and slots handed out, and in free regions, as counted
+		by myalloc_stats */
+	uint64_t mapped;
+	uint64_t in_use;
+	uint64_t free;
+	/*	bytes of empty pages kept for reuse whose memory has not been purged */
+	uint64_t retained;
+	/*	free regions, and their bytes, by size class, class n holding regions of 2^n up
+		to 2^(n+1) bytes */
+	uint64_t free_count[64];
+	uint64_t free_bytes[64];
+} heapdump_heap;
+
+typedef struct heapdump_page {
+	uint64_t address;
+	/*	length of the page, a whole number of cells */
+	uint64_t size;
+	/*	bytes in regions or slots handed out, and in free ones */
+	uint64_t in_use;
+	uint64_t free;
+	/*	number of regions or slots handed out, and of free ones */
+	uint64_t regions;
+	uint64_t free_regions;
+	/*	size of the largest free region */
+	uint64_t largest_free;
+	/*	one of HEAPDUMP_REGIONS, HEAPDUMP_SLAB, HEAPDUMP_RETAINED and HEAPDUMP_ARENA */
+	uint32_t kind;
+	/*	number of cells in the map following */
+	uint32_t cells;
+} heapdump_page;
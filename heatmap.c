@@ -0,0 +1,257 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "heapdump.h"
+
+/*
+ * Reports on a heap dump written by myalloc_heap_dump, see heapdump.h.
+ *
+ * usage: heatmap [-p] [-w width] [-o image.ppm] dump
+ *
+ * For each heap the report gives its footprint, and splits its free bytes by why they
+ * are still held: free system pages that are resident, which myalloc_trim would hand
+ * back, and free bytes sharing a system page with regions in use, which only freeing
+ * those regions would let go. It goes on with a histogram of the heap's free regions by
+ * size, and with -p a line per page.
+ *
+ * With -o the pages are also drawn as a heatmap, a PPM image with a pixel per system
+ * page, width pixels to a row (256 unless given), each page starting on a row of its own
+ * after a black one. Pages not resident are grey; resident ones run from red, for nothing
+ * in use, through yellow to green, for completely in use. The red is what can be given
+ * back; the yellow is fragmentation.
+ */
+
+//pixels a row of the heatmap has when -w does not say otherwise
+#define DEFAULT_WIDTH 256
+
+static const char *KINDS[] = {"?", "regions", "slab", "retained", "arena"};
+
+//the dump as mapped, and its length
+static void *DUMP;
+static size_t DUMP_SIZE;
+
+/*--- DUMP ---*/
+
+//map a heap dump, return false if it cannot be read or is not a heap dump
+static bool dump_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(heapdump_header)) {
+        close(fd);
+        return false;
+    }
+    DUMP = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (DUMP == MAP_FAILED)
+        return false;
+    DUMP_SIZE = status.st_size;
+    return memcmp(((heapdump_header*)DUMP)->magic, HEAPDUMP_MAGIC, sizeof(((heapdump_header*)DUMP)->magic)) == 0;
+}
+
+//return the record of size bytes at offset into the dump, moving offset past it, or NULL
+//if the dump is cut short
+static void *dump_next(size_t *offset, size_t size) {
+    if (size > DUMP_SIZE - *offset)
+        return NULL;
+    void *record = DUMP + *offset;
+    *offset += size;
+    return record;
+}
+
+//return the page record at offset into the dump, and its cells, moving offset past both,
+//or NULL if the dump is cut short
+static heapdump_page *page_next(size_t *offset, unsigned char **cells) {
+    heapdump_page *page = dump_next(offset, sizeof(heapdump_page));
+    if (page == NULL)
+        return NULL;
+    *cells = dump_next(offset, ((size_t)page->cells + 7) & ~(size_t)7);
+    return *cells == NULL ? NULL : page;
+}
+
+/*--- REPORT ---*/
+
+//print a number of bytes in the largest unit that keeps it above 1
+static void print_bytes(uint64_t bytes) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit == 0)
+        printf("%lu B", (unsigned long)bytes);
+    else
+        printf("%.1f %s", value, units[unit]);
+}
+
+//print the report on a heap whose pages start at offset into the dump, move offset past
+//them; return false if the dump is cut short
+static bool report_heap(const heapdump_heap *heap, size_t *offset, uint64_t cell, bool pages) {
+    printf("heap %u, node %u: ", heap->index, heap->node);
+    print_bytes(heap->mapped);
+    printf(" mapped, ");
+    print_bytes(heap->in_use);
+    printf(" in use, ");
+    print_bytes(heap->free);
+    printf(" free, ");
+    print_bytes(heap->retained);
+    printf(" retained\n");
+    uint64_t resident = 0, empty = 0, stranded = 0;
+    for (uint64_t i = 0; i < heap->pages; i++) {
+        unsigned char *cells;
+        heapdump_page *page = page_next(offset, &cells);
+        if (page == NULL)
+            return false;
+        uint64_t pageResident = 0;
+        for (uint32_t j = 0; j < page->cells; j++) {
+            if (cells[j] == HEAPDUMP_NOT_RESIDENT)
+                continue;
+            pageResident += cell;
+            if (cells[j] == 0)
+                empty += cell;
+            else
+                stranded += (100 - cells[j]) * cell / 100;
+        }
+        resident += pageResident;
+        if (pages) {
+            printf("  %#14lx %-8s ", (unsigned long)page->address, KINDS[page->kind <= HEAPDUMP_ARENA ? page->kind : 0]);
+            print_bytes(page->size);
+            printf(", %lu in use in ", (unsigned long)page->regions);
+            print_bytes(page->in_use);
+            printf(", %lu free in ", (unsigned long)page->free_regions);
+            print_bytes(page->free);
+            printf(" (largest ");
+            print_bytes(page->largest_free);
+            printf("), %.0f%% resident\n", page->size == 0 ? 0 : 100.0 * pageResident / page->size);
+        }
+    }
+    printf("  resident ");
+    print_bytes(resident);
+    printf(", of which free pages ");
+    print_bytes(empty);
+    printf(" (given back by myalloc_trim), free bytes in pages in use ");
+    print_bytes(stranded);
+    printf("\n");
+    for (int class = 0; class < 64; class++) {
+        if (heap->free_count[class] == 0)
+            continue;
+        printf("  free %12lu - %-12lu %10lu regions ", 1UL << class, (2UL << class) - 1, (unsigned long)heap->free_count[class]);
+        print_bytes(heap->free_bytes[class]);
+        printf("\n");
+    }
+    return true;
+}
+
+/*--- HEATMAP ---*/
+
+//the colour of a cell
+static void cell_colour(unsigned char cell, unsigned char *pixel) {
+    if (cell == HEAPDUMP_NOT_RESIDENT) {
+        pixel[0] = pixel[1] = pixel[2] = 64;
+    } else if (cell < 50) {
+        pixel[0] = 230;
+        pixel[1] = 30 + cell * 4;
+        pixel[2] = 30;
+    } else {
+        pixel[0] = cell > 100 ? 30 : 230 - (cell - 50) * 4;
+        pixel[1] = 230;
+        pixel[2] = 30;
+    }
+}
+
+//draw the heatmap of the dump's pages into the file at path, return false on failure
+static bool heatmap_write(const char *path, unsigned int width) {
+    const heapdump_header *header = DUMP;
+    //a black row before each page, then as many rows as its cells fill
+    size_t rows = 0;
+    size_t offset = sizeof(heapdump_header);
+    for (uint32_t i = 0; i < header->heaps; i++) {
+        const heapdump_heap *heap = dump_next(&offset, sizeof(heapdump_heap));
+        for (uint64_t j = 0; heap != NULL && j < heap->pages; j++) {
+            unsigned char *cells;
+            heapdump_page *page = page_next(&offset, &cells);
+            if (page == NULL)
+                return false;
+            rows += 1 + (page->cells + width - 1) / width;
+        }
+    }
+    FILE *image = fopen(path, "wb");
+    if (image == NULL)
+        return false;
+    fprintf(image, "P6\n%u %zu\n255\n", width, rows);
+    unsigned char *row = malloc(3 * width);
+    offset = sizeof(heapdump_header);
+    for (uint32_t i = 0; i < header->heaps; i++) {
+        const heapdump_heap *heap = dump_next(&offset, sizeof(heapdump_heap));
+        for (uint64_t j = 0; heap != NULL && j < heap->pages; j++) {
+            unsigned char *cells;
+            heapdump_page *page = page_next(&offset, &cells);
+            memset(row, 0, 3 * width);
+            fwrite(row, 3, width, image);
+            for (uint32_t start = 0; start < page->cells; start += width) {
+                memset(row, 0, 3 * width);
+                for (uint32_t k = 0; k < width && start + k < page->cells; k++)
+                    cell_colour(cells[start + k], &row[3 * k]);
+                fwrite(row, 3, width, image);
+            }
+        }
+    }
+    free(row);
+    return fclose(image) == 0;
+}
+
+/*--- MAIN ---*/
+
+int main(int argc, char *argv[]) {
+    const char *usage = "usage: %s [-p] [-w width] [-o image.ppm] dump\n";
+    const char *output = NULL;
+    unsigned int width = DEFAULT_WIDTH;
+    bool pages = false;
+    int option;
+    while ((option = getopt(argc, argv, "pw:o:")) != -1) {
+        if (option == 'p') {
+            pages = true;
+        } else if (option == 'w' && atoi(optarg) > 0) {
+            width = atoi(optarg);
+        } else if (option == 'o') {
+            output = optarg;
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, usage, argv[0]);
+        return 2;
+    }
+    if (!dump_open(argv[optind])) {
+        fprintf(stderr, "%s: cannot read heap dump %s\n", argv[0], argv[optind]);
+        return 1;
+    }
+    const heapdump_header *header = DUMP;
+    printf("%u heaps, ", header->heaps);
+    print_bytes(header->direct);
+    printf(" in regions mapped on their own\n");
+    size_t offset = sizeof(heapdump_header);
+    for (uint32_t i = 0; i < header->heaps; i++) {
+        const heapdump_heap *heap = dump_next(&offset, sizeof(heapdump_heap));
+        if (heap == NULL || !report_heap(heap, &offset, header->cell_size, pages)) {
+            fprintf(stderr, "%s: heap dump %s is cut short\n", argv[0], argv[optind]);
+            return 1;
+        }
+    }
+    if (output != NULL && !heatmap_write(output, width)) {
+        fprintf(stderr, "%s: cannot write heatmap %s\n", argv[0], output);
+        return 1;
+    }
+    return 0;
+}
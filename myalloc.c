@@ -1,393 +1,3917 @@
-#include <sys/mman.h>
-#include <stdlib.h>
-#include <stdbool.h>
-#include <limits.h>
-#include <unistd.h>
-#include <assert.h>
-#include <stdio.h>
-#include "myalloc.h"
-
-/*--- MACROS ---*/
-/*
- * Memory Layout Example (arbitrary N and M):
- *
- * |--------------N * PAGESIZE---------------|
- * |HEADER|---REGION---|HEADER|--REG--|HEADER|
- *                                           |   page end of one allocation has
- * /-----------------------------------------/   pointer to next page (if any)
- * |
- * V
- * |--------------M * PAGESIZE---------------|
- * |HEADER|---------------------------|HEADER|
- *
- * Use header_print(h); to print out a diagram of your memory, in a similar fashion to this
- */
-#define HEADER_DATA unsigned long
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <signal.h>
+#include <execinfo.h>
+#include "myalloc.h"
+#include "trace.h"
+#include "heapdump.h"
+
+/*--- MACROS ---*/
+/*
+ * Memory Layout Example (arbitrary N and M):
+ *
+ * |--------------N * PAGESIZE---------------|
+ * |PAGE|HEADER|---REGION---|HEADER|--REG--|END|
+ *   |
+ *   |   each page starts with a page header linking it to the
+ *   |   other pages of its heap
+ *   V
+ * |--------------M * PAGESIZE---------------|
+ * |PAGE|HEADER|------------------------|END|
+ *
+ * A header is a single word: neighbouring regions within a page are found from the
+ * region's size, and only free regions carry anything more, in their own space:
+ *
+ * |HEADER|next|prev|----------------|FOOTER|
+ *
+ * The links chain the region into the heap's free regions, and the footer repeats
+ * the size so that the region to the right can find this one's header. Regions are
+ * 16-byte aligned; headers sit just before them, so region sizes are 8 more than a
+ * multiple of 16.
+ *
+ * Use header_print(h); to print out a diagram of your memory, in a similar fashion to this
+ *
+ * Regions of at least MMAP_THRESHOLD bytes are kept out of the page chain entirely;
+ * each gets a mapping of its own, headed by a block header with the mapped-bit set:
+ *
+ * |------------K * PAGESIZE-------------|
+ * |--|HEADER|-----------REGION----------|
+ */
+#define HEADER_DATA unsigned long
 #define HEADER_FROM_REGION(region_p) ((block_header*)((void*)region_p - sizeof(block_header)))
 #define REGION_FROM_HEADER(header_p) ((void*)((void*)header_p + sizeof(block_header)))
-
-//the minimum allocation size
-#define ALLOCATION_MINIMUM sizeof(char)
-//maximum allocation size
-#define ALLOCATION_MAXIMUM ~(((HEADER_DATA)FLAG_COUNT) << HEADER_FREE_BIT)
+#define LINKS_FROM_HEADER(header_p) ((free_links*)REGION_FROM_HEADER(header_p))
+//the footer of a free region, its last word
+#define FOOTER_FROM_HEADER(header_p) ((HEADER_DATA*)(REGION_FROM_HEADER(header_p) + header_getsize(header_p)) - 1)
+//the header of the first region in a page, and the page a first region belongs to
+#define FIRST_HEADER_FROM_PAGE(page_p) ((block_header*)((void*)page_p + sizeof(page_header)))
+#define PAGE_FROM_FIRST_HEADER(header_p) ((page_header*)((void*)header_p - sizeof(page_header)))
+//the page a page-end header belongs to, whose size is its offset into the page
+#define PAGE_FROM_END(header_p) ((page_header*)((void*)header_p - header_getsize(header_p)))
+
+//the minimum allocation size, a free region must be able to hold its links and footer
+#define ALLOCATION_MINIMUM (sizeof(free_links) + sizeof(HEADER_DATA))
+//regions are aligned to this, and with their header span a multiple of it
+#define ALLOCATION_ALIGNMENT 16
+//round a region size up so that the region and its header together keep the next
+//region aligned
+#define ALIGN(size) ((((size) + sizeof(block_header) + ALLOCATION_ALIGNMENT - 1) & ~((size_t)ALLOCATION_ALIGNMENT - 1)) - sizeof(block_header))
+//maximum allocation size
+#define ALLOCATION_MAXIMUM SIZE_MASK
 //number of flags at the start of the data segment
-#define FLAG_COUNT 2
-//mask which hides the flags from the data segment, leaving behind the size
-//i.e. if HEADER_DATA were char, and FLAG_COUNT were 2, FLAG_MASK would be 00111111
-#define FLAG_MASK ~(((1 << FLAG_COUNT) - 1) << (sizeof(HEADER_DATA) * CHAR_BIT - FLAG_COUNT))
-
-/*-------------------------------------------*/
-/*--- HEADER/FOOTER/FUNCTION DECLARATIONS ---*/
-/*-------------------------------------------*/
+#define FLAG_COUNT 5
+//mask which hides the flags from the data segment, leaving behind the size
+//i.e. if HEADER_DATA were char, and FLAG_COUNT were 2, FLAG_MASK would be 00111111
+#define FLAG_MASK ~(((1 << FLAG_COUNT) - 1) << (sizeof(HEADER_DATA) * CHAR_BIT - FLAG_COUNT))
+//number of bits following the flags which hold the index of the owning heap
+#define HEAP_BITS 6
+//position of the lowest heap index bit
+#define HEADER_HEAP_SHIFT (sizeof(HEADER_DATA) * CHAR_BIT - FLAG_COUNT - HEAP_BITS)
+//mask which leaves behind only the size
+#define SIZE_MASK ((((HEADER_DATA)1) << HEADER_HEAP_SHIFT) - 1)
+//the most heaps (arenas) there can be, limited by the bits available to index them
+#define MAX_HEAPS (1 << HEAP_BITS)
+//number of segregated free lists, one per power of two a region size can have
+#define SIZE_CLASS_COUNT (sizeof(HEADER_DATA) * CHAR_BIT)
+
+//requests up to this size are served from the calling thread's cache
+#define TCACHE_MAXIMUM 1024
+//thread cache size classes are this many bytes apart
+#define TCACHE_STEP 16
+#define TCACHE_BINS (TCACHE_MAXIMUM / TCACHE_STEP)
+//a thread cache class holding this many regions gets half of them flushed to the heap
+#define TCACHE_CAPACITY 16
+//the thread cache class whose regions all hold at least size bytes
+#define TCACHE_INDEX(size) ((size) / TCACHE_STEP - 1)
+//the size a request of size bytes is served with from the cache, the smallest class
+//that holds it
+#define TCACHE_REQUEST(size) ((size) == 0 ? TCACHE_STEP : ((size) + TCACHE_STEP - 1) & ~(TCACHE_STEP - 1))
+
+//requests up to this size are carved from slabs instead of given a header
+#define SLAB_MAXIMUM 128
+//slab slot sizes are this many bytes apart, which also keeps slots aligned
+#define SLAB_STEP 16
+#define SLAB_CLASSES (SLAB_MAXIMUM / SLAB_STEP)
+#define SLAB_INDEX(size) ((size) / SLAB_STEP - 1)
+//offset of the first slot in a slab, past the slab header
+#define SLAB_SLOTS_OFFSET ((sizeof(struct slab) + SLAB_STEP - 1) & ~(SLAB_STEP - 1))
+
+//the page map tracks memory in units of 2^PAGEMAP_SHIFT bytes
+#define PAGEMAP_SHIFT 12
+//bits of a page number resolved by each leaf of the page map
+#define PAGEMAP_LEAF_BITS 18
+//bits of a page number resolved by the root, covering a 48-bit address space
+#define PAGEMAP_ROOT_BITS (48 - PAGEMAP_SHIFT - PAGEMAP_LEAF_BITS)
+
+//a heap keeps at most this many empty pages mapped for reuse
+#define RETAIN_SLOTS 32
+
+//size of the huge pages heap pages can be backed with
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+//heap pages are mapped in multiples of this many bytes
+#define PAGE_GRANULE (HUGE_PAGES ? HUGE_PAGE_SIZE : (size_t)getpagesize())
+
+//free space at the end of a heap's top page is decommitted once there is more than twice
+//this much of it, leaving this much committed for the heap to grow back into
+#define TOP_PAD ((size_t)256 << 10)
+
+//freeing a region that leaves at least this many bytes free around it hands the memory of
+//that free region back, if the heap has not done so for TRIM_MS
+#define TRIM_MINIMUM ((size_t)256 << 10)
+
+//traced events are buffered per thread, this many at a time
+#define TRACE_BUFFER_EVENTS 256
+//size of the trace file mapped when MYALLOC_TRACE_SIZE does not say otherwise
+#define TRACE_DEFAULT_SIZE ((size_t)1 << 30)
+
+//arenas take pages from their heap in chunks of at least this many bytes
+#define ARENA_CHUNK ((size_t)64 * 1024)
+//the first object of an arena chunk, past its page header and kept aligned
+#define ARENA_FIRST(page_p) ((void*)(((uintptr_t)((page_header*)(page_p) + 1) + ALLOCATION_ALIGNMENT - 1) & ~((uintptr_t)ALLOCATION_ALIGNMENT - 1)))
+
+//in hardened mode every region ends in a canary of this many bytes
+#define GUARD_SIZE sizeof(uintptr_t)
+//the canary at address, and what it is turned into once its region is freed
+#define CANARY(address) (GUARD_SECRET ^ (uintptr_t)(address))
+#define CANARY_FREED(address) (~CANARY(address))
+//a thread quarantines at most this many freed regions at a time
+#define QUARANTINE_SLOTS 256
+//a full quarantine lets at least this many of its oldest regions go at once, released
+//together as myfree_bulk does
+#define QUARANTINE_BATCH 16
+
+//the call stack of a sampled allocation is recorded to at most this many frames
+#define PROFILE_DEPTH 32
+//the heap profiler keeps track of at most this many call sites, and sampled regions
+#define PROFILE_SITE_SLOTS 4096
+#define PROFILE_OBJECT_SLOTS ((size_t)1 << 16)
+//bits of a region's address that index the counts of sampled regions a free looks at
+#define PROFILE_FILTER_BITS 14
+//bytes between samples on average when MYALLOC_PROFILE_RATE does not say otherwise
+#define PROFILE_DEFAULT_RATE ((size_t)512 * 1024)
+//has a heap profile written to a file named after MYALLOC_PROFILE
+#define PROFILE_SIGNAL SIGUSR2
+
+/*-------------------------------------------*/
+/*--- HEADER/FOOTER/FUNCTION DECLARATIONS ---*/
+/*-------------------------------------------*/
 typedef struct block_header {
-    HEADER_DATA data;
+    HEADER_DATA data;
+} block_header;
+
+/*
+ * Every mapping in a heap's page chain starts with one of these; its size keeps the
+ * first header 8 bytes short of a multiple of 16, so the first region is aligned.
+ */
+typedef struct page_header {
+    struct page_header *next;
+    struct page_header *prev;
+    //length of the whole mapping
+    size_t size;
+} page_header;
+
+/*
+ * Free regions are additionally threaded onto the heap's free structure, which depends
+ * on the placement policy, POLICY:
+ *
+ * segregated fit: a free list per size class, where class n holds every free region
+ * whose size s satisfies 2^n <= s < 2^(n+1). A heap's binmap has bit n set whenever its
+ * list for class n is non-empty.
+ * first fit and next fit: a single list in address order, searched from its start, or
+ * from where the last search left off (the rover).
+ * best fit: a splay tree ordered by size, then address, with prev and next as the
+ * left and right children.
+ *
+ * The links live at the start of the region itself, since a free region holds no
+ * user data; this is why ALLOCATION_MINIMUM is the size of the links and footer.
+ */
+typedef struct free_links {
     struct block_header *next;
     struct block_header *prev;
-} block_header;
-
-/*
- * Header Data Segment:
- * |f|e|--------------...
- *  ^ ^ ^
- *  | | |
- *  | | |
- *  | | |
- *  | | remaining bits are treated as a positive integral number
- *  | |
- *  | page-end-bit
- *  |
- *  free bit
- */
-
-//position of the free-bit, in the number of bits from the lsb (little endian) to it
-const int HEADER_FREE_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 1;
-
-const int HEADER_PAGE_END_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 2;
-
-void init();
-
+} free_links;
+
+/*
+ * Every thread keeps a cache of recently freed regions per size class, so that most
+ * allocations and frees never touch the shared heap, and need no lock at all.
+ * Cached regions stay marked as in-use, which keeps them from being coalesced, and
+ * are chained through their first word; they may be slab slots or headed regions.
+ * Only refilling an empty class and flushing a full one take a heap's lock.
+ */
+typedef struct tcache {
+    void *bins[TCACHE_BINS];
+    unsigned int counts[TCACHE_BINS];
+    //in hardened mode, the regions freed but held back from reuse and their capacities,
+    //a ring whose oldest entry is at quarantineHead, and the bytes they span
+    void *quarantine[QUARANTINE_SLOTS];
+    size_t quarantineCapacities[QUARANTINE_SLOTS];
+    unsigned int quarantineHead;
+    unsigned int quarantineCount;
+    size_t quarantineBytes;
+    bool registered;
+} tcache;
+
+/*
+ * Small requests are served from slabs: single pages, or huge pages when heap pages are
+ * huge, carved into equal slots with no header of their own, so a 16 byte object costs
+ * 16 bytes.
+ *
+ * |SLAB|--slot--|--slot--|--slot--|...|--slot--|
+ *
+ * The slab header at the start of the page holds what a block header otherwise would.
+ * Which slab a slot belongs to is found through the page map, keyed by the page
+ * address, which also tells slots apart from headed regions on free.
+ */
+typedef struct slab {
+    //slabs of the same class with free slots, in their heap
+    struct slab *next;
+    struct slab *prev;
+    //every slab of the heap, full ones included
+    struct slab *allNext;
+    struct slab *allPrev;
+    //heap this slab belongs to
+    struct heap *heap;
+    //chain of freed slots, linked through their first word
+    void *free;
+    //start of the slots never handed out, carved from only once free is empty
+    void *unused;
+    //length of the slab's page, a huge page when they are enabled
+    size_t span;
+    //size of each slot
+    unsigned int size;
+    //number of slots handed out, and the number there are in total
+    unsigned int used;
+    unsigned int capacity;
+} slab;
+
+/*
+ * Pages that become empty are not unmapped straight away; each heap keeps them for
+ * reuse, so a program repeatedly allocating and freeing page sized regions does not
+ * map and unmap them on every cycle. Their memory is handed back to the system with
+ * madvise once retained for DECAY_MS, or while more than RETAIN_LIMIT bytes are held;
+ * the mapping itself is only given up to make room for another page.
+ */
+typedef struct retained_page {
+    void *base;
+    size_t size;
+    //when the page was retained, in milliseconds of the monotonic clock
+    unsigned long since;
+    //the memory has been handed back, and reads as zero when next touched
+    bool purged;
+} retained_page;
+
+/*
+ * An arena (see myalloc.h; unrelated to the heaps, which MYALLOC_ARENAS counts) hands out
+ * memory by bumping a pointer through chunks of pages taken from the creating thread's
+ * heap, with no header per object. The chunks are chained through their page headers,
+ * and the arena itself lives in the first of them, just past its page header. Objects
+ * are never freed one at a time: a reset moves the pointer back to the start of the
+ * first chunk and keeps every chunk for the next round, and destroying the arena gives
+ * its chunks back to the heap as retained pages.
+ */
+struct myarena {
+    struct heap *heap;
+    //the arenas of the same heap
+    struct myarena *arenaNext;
+    struct myarena *arenaPrev;
+    //the chunk being allocated from, and the part of it not yet handed out
+    page_header *chunk;
+    void *next;
+    void *end;
+};
+
+/*
+ * With MYALLOC_TRACE naming a file, every call of the public functions is recorded
+ * there, in the format of trace.h. Each thread collects its events in a buffer of its
+ * own, and copies a full buffer into the memory-mapped file at an offset reserved with
+ * a single atomic add; writing it out is left to the system. The file is mapped at its
+ * full size up front, MYALLOC_TRACE_SIZE, and truncated to what was used at exit; events
+ * which do not fit are dropped and counted.
+ */
+typedef struct trace_buffer {
+    //number of the thread this buffer belongs to, as recorded in its events
+    unsigned int thread;
+    unsigned int count;
+    trace_event events[TRACE_BUFFER_EVENTS];
+} trace_buffer;
+
+/*
+ * With MYALLOC_PROFILE_RATE set to N, the public functions sample the allocations made
+ * through them, one in about every N bytes: each thread counts down the bytes to its
+ * next sample, which is drawn from an exponential distribution, so every byte allocated
+ * is as likely as any other to be the one sampled, and an allocation of s bytes is
+ * sampled with probability 1 - exp(-s / N). A sampled allocation has its call stack
+ * recorded with backtrace, and is counted against that call site, as live until freed.
+ * Profiles give the raw counts per site along with N, in the legacy heap profile format
+ * of gperftools, from which pprof works out the estimated totals.
+ *
+ * Sampled regions are kept in a hash table by address, which a free would have to look
+ * in every time; to spare it that, the table is backed by a filter counting the sampled
+ * regions whose addresses share their low bits, so most frees look no further than a
+ * counter that is zero. Neither table is allocated from the heaps, so a sample is never
+ * sampled in turn. With profiling off, which is the default, the public functions only
+ * test PROFILING, as they do TRACING.
+ */
+typedef struct profile_site {
+    //return addresses of the call stack, the innermost first, and how many there are; a
+    //site with a depth of 0 is an empty slot of the table
+    void *stack[PROFILE_DEPTH];
+    unsigned int depth;
+    //sampled regions from this site still live, and all that have been sampled
+    unsigned long liveCount;
+    size_t liveBytes;
+    unsigned long totalCount;
+    size_t totalBytes;
+} profile_site;
+
+typedef struct profile_object {
+    //the sampled region, NULL for an empty slot of the table
+    void *region;
+    profile_site *site;
+    size_t size;
+} profile_object;
+
+/*
+ * A heap dump, written by myalloc_heap_dump in the format of heapdump.h, is put together
+ * in memory mapped for the purpose, as the heaps cannot be allocated from while they are
+ * being walked. The heaps are walked one at a time, each under its lock only for as long
+ * as it takes to add up the bytes in use in its pages, so only threads allocating from
+ * that heap, and missing their caches, wait for the walk. Asking the system which of the
+ * pages are resident, and writing the dump out, wait until they are all unlocked again.
+ */
+typedef struct dump_buffer {
+    void *data;
+    size_t length;
+    size_t capacity;
+} dump_buffer;
+
+/*
+ * The memory is split between a number of independent heaps (arenas), each with its
+ * own chain of pages, free lists and lock. Threads are assigned a heap round-robin the
+ * first time they need one, so threads on different heaps never contend.
+ * Every header carries the index of the heap it belongs to, so a region can be freed
+ * from any thread. A thread freeing a region of another thread's heap does not take that
+ * heap's lock: it pushes the region onto the heap's remote list with a single
+ * compare-and-swap, linked through the region's first word, and whichever thread next
+ * allocates from the heap takes the whole list with an exchange and releases it in one
+ * batch, under the lock it holds anyway. Until then the regions count as in use.
+ *
+ * With NUMA awareness enabled the heaps are split evenly between the nodes, heap i
+ * belonging to node i % NODE_COUNT, and a thread is assigned one of the heaps of the node
+ * it first allocates on. A heap's pages are bound to its node with mbind, so memory
+ * stays local to the threads using it however it gets recycled. Regions freed by a
+ * thread on another node skip its cache and go straight back to their heap, so they are
+ * never handed out again on the wrong node.
+ *
+ * Each heap reserves a large range of address space up front, RESERVE_SIZE bytes mapped
+ * PROT_NONE, which costs no memory until committed with mprotect. Its first page sits at
+ * the start of the range and is the heap's top page: rather than mapping another page
+ * when it runs out of room, the heap commits the next part of the range and moves the
+ * top page's end up over it, so its old page-end becomes free space that coalesces with
+ * whatever was free before it. Free space gathering at the end of the top page is handed
+ * back the same way, by moving the end down and decommitting what is past it. Only once
+ * the range is used up does the heap map further pages of their own.
+ */
+typedef struct heap {
+    //we store an entry point to the memory (essentially the head to a linked list of pages)
+    page_header *pages;
+    //heads of the free lists, indexed by size class
+    block_header *bins[SIZE_CLASS_COUNT];
+    //bit n is set when bins[n] is non-empty
+    HEADER_DATA binmap;
+    //first free region in address order, for first and next fit
+    block_header *list;
+    //the free region next fit searches on from, or NULL to start with the first
+    block_header *rover;
+    //a free region in the list at or before where the next one is likely inserted,
+    //usually where the last was removed, or NULL
+    block_header *finger;
+    //root of the free regions by size, for best fit
+    block_header *tree;
+    //slabs with free slots, indexed by slot size class
+    slab *slabs[SLAB_CLASSES];
+    //every slab of the heap, for heap dumps
+    slab *allSlabs;
+    //the arenas whose chunks were taken from the heap, for heap dumps
+    struct myarena *arenas;
+    //empty pages kept for reuse, oldest first
+    retained_page retained[RETAIN_SLOTS];
+    unsigned int retainedCount;
+    //bytes of the retained pages that have not been purged
+    size_t retainedBytes;
+    //the page last taken from the retained pages, if its memory was not purged
+    page_header *reused;
+    //the part of the heap's reserved range not committed yet, from reserveTop up to
+    //reserveEnd; both NULL if the heap has no reservation
+    void *reserveTop;
+    void *reserveEnd;
+    //the page at the start of the reservation, which ends at reserveTop, or NULL
+    page_header *top;
+    //when the heap's free space was last handed back to the system, in milliseconds of
+    //the monotonic clock
+    unsigned long trimmed;
+    //bytes of pages mapped for this heap, its retained pages included
+    size_t mapped;
+    //bytes in regions and slab slots handed out, those held by thread caches included
+    size_t inUse;
+    //bytes in free regions, indexed by size class
+    size_t freeBytes[SIZE_CLASS_COUNT];
+    //allocations served from the free lists, and the free regions looked at to do so
+    unsigned long allocations;
+    unsigned long scanned;
+    //guards all of the above
+    pthread_mutex_t lock;
+    //regions freed by threads of other heaps and not yet released, pushed without the lock
+    void *remote;
+    //position of this heap in HEAPS, as stored in its headers
+    unsigned int index;
+    //NUMA node whose memory the heap's pages are bound to
+    unsigned int node;
+} heap;
+
+/*
+ * Header Data Segment:
+ * |f|e|m|p|s|-heap-|--------...
+ *  ^ ^ ^ ^ ^ ^      ^
+ *  | | | | | |      |
+ *  | | | | | |      remaining bits are treated as a positive integral number
+ *  | | | | | |
+ *  | | | | | index of the owning heap, HEAP_BITS wide
+ *  | | | | |
+ *  | | | | page-start-bit, the region is the first in its page
+ *  | | | |
+ *  | | | prev-free-bit, the region to the left is free and has a footer
+ *  | | |
+ *  | | mapped-bit, the region has a mapping of its own
+ *  | |
+ *  | page-end-bit
+ *  |
+ *  free bit
+ */
+
+//position of the free-bit, in the number of bits from the lsb (little endian) to it
+const int HEADER_FREE_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 1;
+
+const int HEADER_PAGE_END_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 2;
+
+const int HEADER_MAPPED_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 3;
+
+const int HEADER_PREV_FREE_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 4;
+
+const int HEADER_PAGE_START_BIT = sizeof(HEADER_DATA) * CHAR_BIT - 5;
+
+//set up the page chain of an empty heap
+void init(heap *heap);
+
+//set up the heaps and their locks, once per process
+void heaps_init();
+
+//return the heap assigned to the calling thread, assigning one if it has none yet
+heap *thread_heap();
+
+//return the NUMA node a newly seen thread belongs to
+unsigned int thread_node();
+
+//read the number of NUMA nodes of the system, 1 if it cannot be told
+unsigned int numa_nodes();
+
+//prefer the given node for the memory of a mapping, if NUMA awareness is enabled
+void numa_bind(void *base, size_t size, unsigned int node);
+
+//lock every heap ahead of a fork, and release them again in the parent and the child
+void heaps_prefork();
+void heaps_postfork_parent();
+void heaps_postfork_child();
+
 /*
  * Allocate n pages-worth of heap space, return a pointer to the beginning of the
- * page as a block header. The block header in question initially represents the
- * whole page as a free region.
- * A header is also placed at the end of the page, with page-end-bit set to 1, and a size of 0
- * this header will always be "in-use" internally; eventually the header's next pointer
- * will point to the base of the next page(s) that get allocated.
+ * page as a page header. The block header following it initially represents the
+ * whole page as a free region, and has its page-start-bit set.
+ * A header is also placed at the end of the page, with page-end-bit set to 1, and a size
+ * of its offset from the page header; this header will always be "in-use" internally.
  * If n is 0, NULL is returned.
  */
-block_header *allocatePage(unsigned int n);
-
+page_header *allocatePage(unsigned int n, unsigned int node);
+
+//map size bytes for heap pages, a multiple of PAGE_GRANULE, backed by huge pages if
+//they are enabled and bound to the given NUMA node; return MAP_FAILED on failure
+void *map_pages(size_t size, unsigned int node);
+
+//map size bytes at a huge page aligned address, return MAP_FAILED on failure
+void *map_aligned(size_t size, int prot, int flags);
+
+//lay out a mapping of size bytes as a page holding a single free region, as allocatePage does
+page_header *page_layout(void *base, size_t size);
+
+//return n pages-worth of heap space, reusing a retained page if one fits, laid out as
+//allocatePage does; the caller must hold the heap's lock
+page_header *page_acquire(heap *heap, unsigned int n);
+
+//keep an empty mapping of size bytes for reuse instead of unmapping it; the caller must
+//hold the heap's lock
+void page_retain(heap *heap, void *base, size_t size);
+
+//hand the memory of retained pages back to the system once they have been held too
+//long, or too much of it is held; the caller must hold the heap's lock
+void page_decay(heap *heap);
+
+//reserve the range of address space the heap's top page grows into, and commit its first
+//page; return false if the heap cannot have a reservation
+bool reserve_init(heap *heap);
+
+//commit size more bytes of the heap's reservation, a multiple of PAGE_GRANULE, return where
+//they start or NULL if the reservation is used up
+void *reserve_commit(heap *heap, size_t size);
+
+//hand the last size bytes committed of the heap's reservation back to the system
+void reserve_decommit(heap *heap, size_t size);
+
+//grow the heap's top page until the free region ending it holds at least size bytes, return
+//that region, or NULL if the reservation is used up; the caller must hold the heap's lock
+block_header *top_grow(heap *heap, size_t size);
+
+//shrink the heap's top page while too much is free at its end, header being the free region
+//ending it; the caller must hold the heap's lock
+void top_trim(heap *heap, block_header *header);
+
+//hand the memory of the heap's free space back to the system, return how many bytes of it
+//were resident; the caller must hold the heap's lock
+size_t heap_trim(heap *heap);
+
+//add a record of the heap and its pages to a heap dump, counts being where the bytes in
+//use of each cell are added up, return false if out of memory; the caller must hold the
+//heap's lock
+bool dump_heap(dump_buffer *buffer, dump_buffer *counts, heap *heap);
+
+//add a record of the page of size bytes at base to a heap dump, counts giving the bytes in
+//use of each of its cells; return the record, or NULL if out of memory
+heapdump_page *dump_page(dump_buffer *buffer, int32_t *counts, void *base, size_t size, uint32_t kind);
+
+//mark the cells of a heap dump's pages whose memory is not resident, once the heaps are
+//unlocked, using scratch for the system's answers; return false if out of memory
+bool dump_residency(dump_buffer *buffer, dump_buffer *scratch);
+
+//add sign times the bytes from start to end, within the page at base, to the counts of
+//the cells they cover
+void dump_count(int32_t *counts, void *base, void *start, void *end, int sign);
+
+//return size more zeroed bytes at the end of a heap dump, or NULL if out of memory; the
+//buffer may move
+void *dump_reserve(dump_buffer *buffer, size_t size);
+
+//hand the whole granules between start and end back to the system, return how many bytes
+//of them were resident
+size_t purge_range(void *start, void *end);
+
+//return how many bytes of the size bytes at base, a whole number of pages, are resident
+size_t resident_bytes(void *base, size_t size);
+
+//return the time of the monotonic clock in milliseconds
+unsigned long now_ms();
+
+//return the time of the monotonic clock in nanoseconds
+unsigned long now_ns();
+
+//return the size of the largest free region of the heap; the caller must hold its lock
+size_t largest_free(heap *heap);
+
+//allocate a region of at least size bytes from wherever suits its size, as myalloc does
+//without the tracing
+void *allocate_region(size_t size);
+
+//free a region wherever it was allocated from, as myfree does without the tracing
+void release_region(void *ptr);
+
+//free a region allocated with size bytes as myfree_sized does without the tracing
+void release_sized(void *ptr, size_t size);
+
+//resize a region as myrealloc does without the profiling; a resize that releases the
+//region is traced here, before the release lets another thread have it
+void *reallocate_region(void *ptr, size_t size);
+
+//allocate a zeroed region as mycalloc does without the tracing
+void *allocate_zeroed(size_t count, size_t size);
+
+//allocate an aligned region as myaligned_alloc does without the tracing
+void *allocate_aligned_region(size_t alignment, size_t size);
+
+//allocate count regions of size bytes as myalloc_bulk does without the tracing
+size_t allocate_bulk(size_t size, size_t count, void **regions);
+
+//free a batch of regions as myfree_bulk does without the tracing
+void release_bulk(void **regions, size_t count);
+
+//allocate count regions of size bytes by splitting up a single region, or one at a time
+//if there is no region that large; return how many were allocated; the caller must hold
+//the heap's lock
+size_t allocate_run(heap *heap, size_t size, size_t count, void **regions);
+
+//resize a region to hold at least size bytes without copying it, return the region or NULL
+//if it cannot be resized in place; a region with a mapping of its own may move with it
+void *resize_region(void *ptr, size_t size);
+
+//return whether hardened mode is on, setting up the heaps first if they are not yet,
+//since it is only known once they are
+bool hardened();
+
+//allocate, free, resize and so on as the functions above do, for hardened mode: each
+//region gets a canary, which is checked on its way back, and freed regions are quarantined
+void *guard_allocate(size_t size);
+void guard_release(void *ptr);
+void *guard_reallocate(void *ptr, size_t size);
+void *guard_zeroed(size_t count, size_t size);
+void *guard_aligned(size_t alignment, size_t size);
+size_t guard_bulk(size_t size, size_t count, void **regions);
+void guard_release_bulk(void **regions, size_t count);
+
+//write the canary at the end of a region, return the region
+void *guard_seal(void *region);
+
+//check that region was handed out and not freed since, and that its canary is intact,
+//aborting otherwise; return its capacity
+size_t guard_check(void *region);
+
+//report misuse of the heap found at region, and abort
+void guard_fail(const char *problem, void *region);
+
+//hold a freed region of the given capacity in the calling thread's quarantine, releasing
+//the oldest regions to make room for it
+void quarantine_put(void *region, size_t capacity);
+
+//set up the heap profiler to sample every rate bytes on average, and to write a profile to
+//a file named after path on PROFILE_SIGNAL if path is not NULL
+void profile_init(size_t rate, const char *path);
+
+//count an allocation of size bytes towards the calling thread's next sample, sampling it
+//if it is due
+void profile_allocate(void *region, size_t size);
+
+//record the call stack of an allocation due to be sampled, and draw the next interval
+void profile_sample(void *region, size_t size);
+
+//forget a region about to be freed, if it was sampled
+void profile_release(void *region);
+
+//return the number of bytes to the calling thread's next sample, drawn at random
+size_t profile_interval();
+
+//return the natural logarithm of x, for 0 < x <= 1
+double profile_log(double x);
+
+//return the site of the profiler's table with the given call stack, adding it if new, or
+//NULL if the table is full; the caller must hold PROFILE_LOCK
+profile_site *profile_site_find(void **stack, unsigned int depth);
+
+//return the slot of the profiler's table of sampled regions a region is looked for from
+size_t profile_slot(void *region);
+
+//return the counter of the sampled regions filter a region belongs to
+unsigned int profile_bucket(void *region);
+
+//write a heap profile to an open file, return false on failure
+bool profile_write(int fd);
+
+//record that a profile was asked for by signal, to be written at the next sample
+void profile_signal(int signal);
+
+//release a batch of the oldest regions of a thread's quarantine, and more until room more
+//bytes fit in it, checking their canaries were not written to
+void quarantine_evict(tcache *cache, size_t room);
+
+//start recording a trace into the file at path, mapping size bytes of it
+void trace_init(const char *path, size_t size);
+
+//record an event in the calling thread's trace buffer, flushing the buffer if full
+void trace_record(unsigned int kind, void *address, void *previous, size_t size);
+
+//copy a thread's buffered events into the trace file
+void trace_flush(trace_buffer *buffer);
+
+//flush and unmap a thread's trace buffer, used on thread exit
+void trace_destroy(void *buffer);
+
 //allocate new heap space with an added header, size is clamped between
-//ALLOCATION_MINIMUM and ALLOCATION_MAXIMUM inclusive
-block_header *allocate(unsigned int size);
-
-//return pointer to heap space in the first free region that can support a new
-//block allocation of the specified size
-block_header *first_fit(unsigned int size);
+//ALLOCATION_MINIMUM and ALLOCATION_MAXIMUM inclusive; return NULL if out of memory
+//the caller must hold the heap's lock
+block_header *allocate(heap *heap, size_t size);
+
+//return an in-use region to its heap, coalescing it and releasing its page if empty
+//the caller must hold the lock of the heap owning the region
+void release(block_header *header);
+
+//allocate a region of exactly size bytes, from a slab if small enough, or NULL if
+//out of memory; the caller must hold the heap's lock
+void *allocate_small(heap *heap, unsigned int size);
+
+//take a region of at least size bytes from the calling thread's cache, or NULL if empty
+void *tcache_get(unsigned int size);
+
+//have the calling thread's cache flushed when the thread exits
+void tcache_register();
+
+//put an in-use region of size bytes into the calling thread's cache, flushing the
+//class if full
+void tcache_put(void *region, unsigned int size);
+
+//allocate a region of exactly size bytes from the heap, filling the calling
+//thread's cache for that class with more of them on the way
+void *tcache_refill(unsigned int size);
+
+//return regions from one class of a thread cache to the heap, until keep remain
+void tcache_flush(tcache *cache, int index, unsigned int keep);
+
+//return every region held by a thread's cache to the heap, used on thread exit
+void tcache_destroy(void *cache);
+
+//hand a chain of regions of another thread's heap, linked through their first words from
+//first to last, back to that heap without waiting for its lock
+void remote_push(heap *heap, void *first, void *last);
+
+//take a chunk of pages with room for size bytes from the heap for an arena, counting it
+//as in use, or NULL if out of memory; the caller must hold the heap's lock
+page_header *arena_chunk(heap *heap, size_t size);
+
+//move an arena on to a chunk with room for size more bytes, the one after its current
+//chunk if that was kept through a reset and is large enough; return false if out of memory
+bool arena_advance(myarena *arena, size_t size);
+
+//release the regions other threads have handed back to the heap; the caller must hold
+//the heap's lock
+void remote_drain(heap *heap);
+
+//hand out a free slot of size bytes from one of the heap's slabs, creating a slab if
+//there is none with room; the caller must hold the heap's lock
+void *slab_allocate(heap *heap, unsigned int size);
+
+//create an empty slab of size byte slots for the heap, from a freshly allocated page
+slab *slab_create(heap *heap, unsigned int size);
+
+//return a slot to its slab, releasing the slab's page if it becomes empty and is not
+//the only slab of its class with room; the caller must hold the slab's heap's lock
+void slab_free(slab *slab, void *slot);
+
+//return the slab holding the given address, or NULL if it is not within a slab
+slab *pagemap_get(void *address);
+
+//record value as the slab holding each page of the given range
+void pagemap_set(void *address, size_t length, slab *value);
+
+//return pointer to heap space in a free region that can support a new block
+//allocation of the specified size, found by the placement policy
+block_header *place_region(heap *heap, size_t size);
+
+//append a new region to the end of the memory, creates a new page if needed
+block_header *append_region(heap *heap, size_t size);
+
+//divide a region into two, based on size, updating the necessary header pointers
+block_header *divide(block_header *header, size_t size);
+
+//shrink an in-use region to size bytes, returning what is left over to the heap if it
+//is enough for a region of its own; the caller must hold the region's heap's lock
+void trim(block_header *header, size_t size);
+
+//grow an in-use region to at least size bytes by absorbing a free right neighbour,
+//return false if there is no room to; the caller must hold the region's heap's lock
+bool expand(block_header *header, size_t size);
+
+//allocate a region of size bytes whose address is a multiple of alignment, by
+//splitting the misaligned front off a larger region; the caller must hold the heap's lock
+block_header *allocate_aligned(heap *heap, size_t alignment, size_t size);
+
+//give a region of at least size bytes a mapping of its own, return NULL on failure
+block_header *map_region(size_t size);
+
+//give a region of at least size bytes, whose address is a multiple of alignment, a
+//mapping of its own; return NULL on failure
+block_header *map_aligned_region(size_t alignment, size_t size);
+
+//resize a region with a mapping of its own to at least size bytes, moving it if the
+//mapping cannot grow in place, unless tracing, which has to record the move before the
+//old mapping is released; return NULL on failure, leaving the region untouched
+block_header *remap_region(block_header *header, size_t size);
+
+//return the mapping of a region with a mapping of its own to the system
+void unmap_region(block_header *header);
+
+//return the number of bytes a region can hold, wherever it was allocated from
+size_t region_capacity(void *region);
+
+//return the size class that a region of the given size belongs to
+int size_class(size_t size);
+
+//add a free region to its heap's free structure
+void bin_insert(block_header *header);
+
+//remove a free region from its heap's free structure
+void bin_remove(block_header *header);
+
+//return a free region of the heap with at least size bytes, chosen by the placement
+//policy, or NULL if there is none
+block_header *bin_find(heap *heap, size_t size);
+
+//add a free region to the free list of its size class, for segregated fit
+void class_insert(heap *heap, block_header *header);
+
+//remove a free region from the free list of its size class
+void class_remove(heap *heap, block_header *header);
+
+//return a free region with at least size bytes from the size class free lists
+block_header *class_find(heap *heap, size_t size);
+
+//add a free region to the address ordered list, for first and next fit
+void list_insert(heap *heap, block_header *header);
+
+//remove a free region from the address ordered list
+void list_remove(heap *heap, block_header *header);
+
+//return the first free region with at least size bytes in address order, starting
+//from the rover for next fit
+block_header *list_find(heap *heap, size_t size);
+
+//add a free region to the tree of free regions by size, for best fit
+void tree_insert(heap *heap, block_header *header);
+
+//remove a free region from the tree of free regions by size
+void tree_remove(heap *heap, block_header *header);
+
+//return the smallest free region with at least size bytes from the tree
+block_header *tree_find(heap *heap, size_t size);
+
+//splay the node of the tree under root closest to the key (size, key) up to the root,
+//adding the nodes looked at to visited if not NULL; return the new root
+block_header *tree_splay(block_header *root, size_t size, block_header *key, unsigned long *visited);
+
+//coalesce this region and the region to its right
+//return NULL if header is NULL, non-free or is a page-end
+//if the region on the right is NULL, non-free or is a page end then nothing will change
+//return the header of the combined region
+block_header *coalesce(block_header *header);
+
+//deallocate the page(s) holding header, if header is a free region spanning all of them,
+//or give back the free end of the top page
+void clean(block_header *header);
+
+//print a visual representation of the memory starting from header, moving right
+void header_print(block_header *header);
+
+//return the header of the region to the right, which is a page-end if header is last
+block_header *header_next(block_header *header);
+
+//return the header of the region to the left, only valid if header_isprevfree(header)
+block_header *header_prev(block_header *header);
+
+//return the corresponding region size from the header's data segment
+size_t header_getsize(block_header *header);
+
+//set the size value for the header to the value of size
+//warning, bits of the size overlapping the flags and heap index are ignored!
+void header_setsize(block_header *header, size_t size);
+
+//return true if the region this header corresponds to is marked as free
+bool header_isfree(block_header *header);
+
+//set the header's free-flag to the value of free
+void header_setfree(block_header *header, bool free);
+
+//return true if the header's page-end-bit is set
+bool header_isend(block_header *header);
+
+//set the header's page-eng-flag to the value of end
+void header_setend(block_header *header, bool end);
+
+//return true if the header's mapped-bit is set
+bool header_ismapped(block_header *header);
+
+//set the header's mapped-flag to the value of mapped
+void header_setmapped(block_header *header, bool mapped);
+
+//return true if the header's prev-free-bit is set
+bool header_isprevfree(block_header *header);
+
+//set the header's prev-free-flag to the value of free
+void header_setprevfree(block_header *header, bool free);
+
+//return true if the header's page-start-bit is set
+bool header_isstart(block_header *header);
+
+//set the header's page-start-flag to the value of start
+void header_setstart(block_header *header, bool start);
+
+//return the heap owning the region this header corresponds to
+heap *header_getheap(block_header *header);
+
+//set the heap owning the region this header corresponds to
+void header_setheap(block_header *header, heap *heap);
+
+//all heaps; only the first HEAP_COUNT are in use
+static heap HEAPS[MAX_HEAPS];
+
+//number of heaps threads are spread across, MYALLOC_ARENAS or the number of CPUs
+static unsigned int HEAP_COUNT = 1;
+
+//the heap the next thread will be assigned, of those of each NUMA node
+static unsigned int NEXT_HEAP[MAX_HEAPS];
+
+//number of NUMA nodes the heaps are split between, MYALLOC_NUMA=on for the system's
+//nodes or MYALLOC_NUMA_FAKE for a fake topology; 1 without NUMA awareness
+static unsigned int NODE_COUNT = 1;
+
+//with a fake topology, which has no CPUs to go by, threads are assigned nodes in turn;
+//fake node n binds its memory to the system's node n % SYSTEM_NODES
+static bool FAKE_NODES = false;
+static unsigned int NEXT_NODE = 0;
+static unsigned int SYSTEM_NODES = 1;
+
+//requests of at least this many bytes get a mapping of their own, MYALLOC_MMAP_THRESHOLD
+static size_t MMAP_THRESHOLD = 128 * 1024;
+
+//the most bytes of empty pages a heap keeps without purging them, MYALLOC_RETAIN
+static size_t RETAIN_LIMIT = 4 * 1024 * 1024;
+
+//empty pages are purged once retained for this many milliseconds, MYALLOC_DECAY_MS
+static unsigned long DECAY_MS = 1000;
+
+//heaps hand the memory of a large free region back to the system at most once every this
+//many milliseconds as regions are freed, MYALLOC_TRIM_MS; 0 leaves it to myalloc_trim
+static unsigned long TRIM_MS = 10000;
+
+//bytes of address space reserved for each heap's top page to grow into, MYALLOC_RESERVE;
+//with 0 the heaps map each of their pages separately
+static size_t RESERVE_SIZE = (size_t)1 << 30;
+
+/*
+ * With MYALLOC_HUGEPAGES set, heap pages are mapped in whole 2 MiB huge pages, so a large
+ * heap takes far fewer TLB entries. "thp" asks for transparent huge pages, with mappings
+ * aligned to the huge page size and madvise(MADV_HUGEPAGE); "hugetlb" maps them from the
+ * system's reserved huge pages, falling back on transparent ones when none are left.
+ * A huge page is then the smallest unit a heap maps, retains, purges and unmaps, so one
+ * is never split up between the heap and the system.
+ */
+static bool HUGE_PAGES = false;
+static bool HUGETLB = false;
+
+/*
+ * With MYALLOC_HARDENED=on, misuse of the heap is caught where it happens rather than
+ * showing up later as a corrupt heap. Every region gets GUARD_SIZE bytes more than asked
+ * for, and its last word holds a canary, CANARY of its address, which is checked when
+ * the region comes back: a region overrun has lost it, a pointer never handed out almost
+ * certainly has none, and a region already freed has it turned into CANARY_FREED. The
+ * headers of headed regions and the slot offsets of slab slots are checked on the way. A
+ * freed region is not reused straight away but held in its thread's quarantine, which
+ * lets its oldest QUARANTINE_BATCH regions go together once it holds QUARANTINE_LIMIT
+ * bytes or QUARANTINE_SLOTS regions, so a second free finds it still marked as freed,
+ * and a stale pointer cannot yet reach another object; a write through one that overran
+ * the canary is found as the region leaves. Each of these aborts the program with a
+ * message. The checks touch no more than the header and the last word of a region, but
+ * they are not free: the region's capacity is looked up on allocation as well as
+ * release, the canary can push a region into the next size class, and the quarantine
+ * turns over on every free. On the benchmark, calls take a fifth to a half longer than
+ * without, the most with mixed sizes across threads.
+ */
+static bool HARDENED = false;
+
+//bytes of freed regions each thread quarantines in hardened mode, MYALLOC_QUARANTINE
+static size_t QUARANTINE_LIMIT = 256 * 1024;
+
+//mixed into every canary, so that one cannot be made up from an address alone
+static uintptr_t GUARD_SECRET;
+
+//set while allocations are being sampled, every PROFILE_RATE bytes on average
+static bool PROFILING = false;
+static size_t PROFILE_RATE;
+
+//the prefix of the files profiles asked for by signal are written to, MYALLOC_PROFILE
+static const char *PROFILE_PATH;
+
+//the call sites, and the sampled regions still live, mapped when profiling starts
+static profile_site *PROFILE_SITES;
+static profile_object *PROFILE_OBJECTS;
+static size_t PROFILE_OBJECT_COUNT = 0;
+
+//the number of sampled regions in PROFILE_OBJECTS by the low bits of their addresses
+static unsigned short PROFILE_FILTER[1 << PROFILE_FILTER_BITS];
+
+//guards the tables above
+static pthread_mutex_t PROFILE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+//set by PROFILE_SIGNAL, and the number of profiles written for it so far
+static volatile sig_atomic_t PROFILE_REQUESTED = 0;
+static unsigned int PROFILE_DUMPS = 0;
+
+//bytes the calling thread has yet to allocate before its next sample, 0 until drawn
+static __thread size_t PROFILE_COUNTDOWN;
+
+//state of the calling thread's random number generator for the intervals
+static __thread uint64_t PROFILE_SEED;
+
+//set while the calling thread samples, so what backtrace allocates is not sampled
+static __thread bool PROFILE_BUSY;
+
+//how free regions are chosen for allocations, MYALLOC_POLICY or myalloc_set_policy
+static enum myalloc_policy POLICY = MYALLOC_SEGREGATED_FIT;
+
+//the names MYALLOC_POLICY takes, by policy
+static const char *POLICY_NAMES[] = {"segregated", "first-fit", "next-fit", "best-fit"};
+
+static pthread_once_t HEAPS_ONCE = PTHREAD_ONCE_INIT;
+
+//the heap assigned to the calling thread
+static __thread heap *THREAD_HEAP;
+
+//root of the page map, its leaves are allocated as pages first get recorded
+static slab **PAGEMAP[1 << PAGEMAP_ROOT_BITS];
+
+//bytes of regions with mappings of their own
+static size_t DIRECT_BYTES = 0;
+
+//calls made to map and unmap memory for regions, pages and slabs
+static unsigned long MMAP_COUNT = 0;
+static unsigned long MUNMAP_COUNT = 0;
+
+//set while calls are being traced into TRACE_FILE
+static bool TRACING = false;
+
+//the trace file as mapped, and the number of events there is room for
+static trace_header *TRACE_FILE;
+static size_t TRACE_CAPACITY;
+static int TRACE_FD;
+
+//events reserved room for in the trace file so far, some of them perhaps still being copied
+static size_t TRACE_RESERVED = 0;
+
+//the time tracing started, which event times are relative to
+static unsigned long TRACE_START;
+
+//number of threads that have traced an event
+static unsigned int TRACE_THREADS = 0;
+
+//the calling thread's buffer of events, and the key that flushes it when the thread exits
+static __thread trace_buffer *TRACE_BUFFER;
+static pthread_key_t TRACE_KEY;
+
+//the calling thread's cache of freed regions
+static __thread tcache CACHE;
+
+//flushes a thread's cache when it exits
+static pthread_key_t CACHE_KEY;
+static pthread_once_t CACHE_KEY_ONCE = PTHREAD_ONCE_INIT;
+
+/*------------------------------*/
+/*--- MYALLOC IMPLEMENTATION ---*/
+/*------------------------------*/
+void *myalloc(size_t size) {
+    void *region = hardened() ? guard_allocate(size) : allocate_region(size);
+    if (TRACING && region != NULL)
+        trace_record(TRACE_ALLOC, region, NULL, size);
+    if (PROFILING && region != NULL)
+        profile_allocate(region, size);
+    return region;
+}
+
+void myfree(void *ptr) {
+    if (TRACING && ptr != NULL)
+        trace_record(TRACE_FREE, ptr, NULL, 0);
+    if (PROFILING && ptr != NULL)
+        profile_release(ptr);
+    if (hardened())
+        guard_release(ptr);
+    else
+        release_region(ptr);
+}
+
+void myfree_sized(void *ptr, size_t size) {
+    if (TRACING && ptr != NULL)
+        trace_record(TRACE_FREE, ptr, NULL, 0);
+    if (PROFILING && ptr != NULL)
+        profile_release(ptr);
+    if (hardened())
+        guard_release(ptr);
+    else
+        release_sized(ptr, size);
+}
+
+void *myrealloc(void *ptr, size_t size) {
+    //the region may be handed out again by another thread as soon as it is released, so
+    //its sample goes first, and is lost should the resize fail
+    if (PROFILING && ptr != NULL)
+        profile_release(ptr);
+    void *region = hardened() ? guard_reallocate(ptr, size) : reallocate_region(ptr, size);
+    //a resize that released the old region was traced before the release; a failed one
+    //leaves the region as it was, so there is nothing to replay
+    if (TRACING && region != NULL && (ptr == NULL || region == ptr))
+        trace_record(TRACE_REALLOC, region, ptr, size);
+    if (PROFILING && region != NULL)
+        profile_allocate(region, size);
+    return region;
+}
+
+void *mycalloc(size_t count, size_t size) {
+    void *region = hardened() ? guard_zeroed(count, size) : allocate_zeroed(count, size);
+    if (TRACING && region != NULL)
+        trace_record(TRACE_CALLOC, region, NULL, count * size);
+    if (PROFILING && region != NULL)
+        profile_allocate(region, count * size);
+    return region;
+}
+
+void *myaligned_alloc(size_t alignment, size_t size) {
+    void *region = hardened() ? guard_aligned(alignment, size) : allocate_aligned_region(alignment, size);
+    if (TRACING && region != NULL)
+        trace_record(TRACE_ALIGNED, region, (void*)alignment, size);
+    if (PROFILING && region != NULL)
+        profile_allocate(region, size);
+    return region;
+}
+
+size_t myalloc_bulk(size_t size, size_t count, void **regions) {
+    size_t allocated = hardened() ? guard_bulk(size, count, regions) : allocate_bulk(size, count, regions);
+    for (size_t i = 0; TRACING && i < allocated; i++)
+        trace_record(TRACE_ALLOC, regions[i], NULL, size);
+    for (size_t i = 0; PROFILING && i < allocated; i++)
+        profile_allocate(regions[i], size);
+    return allocated;
+}
+
+void myfree_bulk(void **regions, size_t count) {
+    for (size_t i = 0; TRACING && i < count; i++) {
+        if (regions[i] != NULL)
+            trace_record(TRACE_FREE, regions[i], NULL, 0);
+    }
+    for (size_t i = 0; PROFILING && i < count; i++) {
+        if (regions[i] != NULL)
+            profile_release(regions[i]);
+    }
+    if (hardened())
+        guard_release_bulk(regions, count);
+    else
+        release_bulk(regions, count);
+}
+
+void myalloc_stats(struct myalloc_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    unsigned long allocations = 0;
+    unsigned long scanned = 0;
+    for (unsigned int i = 0; i < HEAP_COUNT; i++) {
+        heap *heap = &HEAPS[i];
+        pthread_mutex_lock(&heap->lock);
+        stats->mapped += heap->mapped;
+        stats->in_use += heap->inUse;
+        stats->retained += heap->retainedBytes;
+        for (int class = 0; class < SIZE_CLASS_COUNT; class++) {
+            stats->free_by_class[class] += heap->freeBytes[class];
+            stats->free += heap->freeBytes[class];
+        }
+        size_t largest = largest_free(heap);
+        if (largest > stats->largest_free)
+            stats->largest_free = largest;
+        allocations += heap->allocations;
+        scanned += heap->scanned;
+        pthread_mutex_unlock(&heap->lock);
+    }
+    size_t direct = __atomic_load_n(&DIRECT_BYTES, __ATOMIC_RELAXED);
+    stats->mapped += direct;
+    stats->in_use += direct;
+    stats->mmaps = __atomic_load_n(&MMAP_COUNT, __ATOMIC_RELAXED);
+    stats->munmaps = __atomic_load_n(&MUNMAP_COUNT, __ATOMIC_RELAXED);
+    stats->fragmentation = stats->free == 0 ? 0 : 1 - (double)stats->largest_free / stats->free;
+    stats->scanned_per_alloc = allocations == 0 ? 0 : (double)scanned / allocations;
+}
+
+size_t myalloc_usable_size(void *ptr) {
+    return ptr == NULL ? 0 : region_capacity(ptr) - (HARDENED ? GUARD_SIZE : 0);
+}
+
+int myalloc_set_policy(enum myalloc_policy policy) {
+    if (policy < MYALLOC_SEGREGATED_FIT || policy > MYALLOC_BEST_FIT)
+        return -1;
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    //each policy keeps free regions in a structure of its own, so it can only change
+    //while there are none
+    bool empty = true;
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        pthread_mutex_lock(&HEAPS[i].lock);
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        empty = empty && HEAPS[i].binmap == 0 && HEAPS[i].list == NULL && HEAPS[i].tree == NULL;
+    if (empty)
+        POLICY = policy;
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        pthread_mutex_unlock(&HEAPS[i].lock);
+    return empty ? 0 : -1;
+}
+
+size_t myalloc_trim() {
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    //the regions the calling thread has cached go back to their heaps first
+    for (int i = 0; i < TCACHE_BINS; i++) {
+        if (CACHE.counts[i] > 0)
+            tcache_flush(&CACHE, i, 0);
+    }
+    size_t released = 0;
+    for (unsigned int i = 0; i < HEAP_COUNT; i++) {
+        heap *heap = &HEAPS[i];
+        pthread_mutex_lock(&heap->lock);
+        //so that releasing what other threads handed back does not trim the heap first
+        heap->trimmed = now_ms();
+        remote_drain(heap);
+        released += heap_trim(heap);
+        pthread_mutex_unlock(&heap->lock);
+    }
+    return released;
+}
+
+int myalloc_heap_dump(const char *path) {
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    dump_buffer buffer = {NULL, 0, 0};
+    dump_buffer counts = {NULL, 0, 0};
+    bool dumped = dump_reserve(&buffer, sizeof(heapdump_header)) != NULL;
+    for (unsigned int i = 0; dumped && i < HEAP_COUNT; i++) {
+        pthread_mutex_lock(&HEAPS[i].lock);
+        dumped = dump_heap(&buffer, &counts, &HEAPS[i]);
+        pthread_mutex_unlock(&HEAPS[i].lock);
+    }
+    if (dumped) {
+        heapdump_header *header = buffer.data;
+        memcpy(header->magic, HEAPDUMP_MAGIC, sizeof(header->magic));
+        header->cell_size = getpagesize();
+        header->direct = __atomic_load_n(&DIRECT_BYTES, __ATOMIC_RELAXED);
+        header->heaps = HEAP_COUNT;
+        dumped = dump_residency(&buffer, &counts);
+    }
+    int fd = dumped ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    if (fd >= 0) {
+        ssize_t written = 0;
+        for (size_t offset = 0; written >= 0 && offset < buffer.length; offset += written)
+            written = write(fd, buffer.data + offset, buffer.length - offset);
+        dumped = close(fd) == 0 && written >= 0;
+    }
+    if (buffer.data != NULL)
+        munmap(buffer.data, buffer.capacity);
+    if (counts.data != NULL)
+        munmap(counts.data, counts.capacity);
+    return fd >= 0 && dumped ? 0 : -1;
+}
+
+int myalloc_profile_dump(const char *path) {
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    if (!PROFILING)
+        return -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    bool written = profile_write(fd);
+    return close(fd) == 0 && written ? 0 : -1;
+}
+
+/*--- REGIONS ---*/
+
+//allocate a region of at least size bytes from wherever suits its size, as myalloc does
+//without the tracing
+void *allocate_region(size_t size) {
+    if (size <= TCACHE_MAXIMUM) {
+        //round up to the cache's granularity, so the region can be reused for the class
+        unsigned int request = TCACHE_REQUEST(size);
+        void *region = tcache_get(request);
+        return region != NULL ? region : tcache_refill(request);
+    }
+    if (size > ALLOCATION_MAXIMUM)
+        return NULL;
+    //looking up the heap first also makes sure MMAP_THRESHOLD has been configured
+    heap *heap = thread_heap();
+    block_header *header;
+    if (size >= MMAP_THRESHOLD) {
+        header = map_region(size);
+    } else {
+        pthread_mutex_lock(&heap->lock);
+        header = allocate(heap, size);
+        pthread_mutex_unlock(&heap->lock);
+    }
+    return header == NULL ? NULL : REGION_FROM_HEADER(header);
+}
+
+//free a region wherever it was allocated from, as myfree does without the tracing
+void release_region(void *ptr) {
+    if (ptr == NULL)
+        return;
+    slab *slab = pagemap_get(ptr);
+    block_header *header = HEADER_FROM_REGION(ptr);
+    if (slab == NULL && header_ismapped(header)) {
+        unmap_region(header);
+        return;
+    }
+    heap *heap = slab != NULL ? slab->heap : header_getheap(header);
+    size_t size = slab != NULL ? slab->size : header_getsize(header);
+    //a region from another NUMA node goes back there, rather than be reused on this one
+    if (size <= TCACHE_MAXIMUM && (NODE_COUNT == 1 || heap->node == thread_heap()->node)) {
+        tcache_put(ptr, size);
+        return;
+    }
+    if (heap != thread_heap()) {
+        remote_push(heap, ptr, ptr);
+        return;
+    }
+    pthread_mutex_lock(&heap->lock);
+    if (slab != NULL)
+        slab_free(slab, ptr);
+    else
+        release(header);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+//free a region allocated with size bytes as myfree_sized does without the tracing
+void release_sized(void *ptr, size_t size) {
+    //a region that small was served from the cache class its size rounds up to, and holds
+    //at least that much, so it can be cached without looking at it; it cannot have a
+    //mapping of its own unless mycalloc mapped it, and its heap only matters with several
+    //NUMA nodes
+    if (ptr != NULL && size <= TCACHE_MAXIMUM && size < MMAP_THRESHOLD && NODE_COUNT == 1) {
+        tcache_put(ptr, TCACHE_REQUEST(size));
+        return;
+    }
+    release_region(ptr);
+}
+
+//resize a region as myrealloc does without the profiling; a resize that releases the
+//region is traced here, before the release lets another thread have it
+void *reallocate_region(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return allocate_region(size);
+    if (size == 0) {
+        if (TRACING)
+            trace_record(TRACE_REALLOC, NULL, ptr, 0);
+        release_region(ptr);
+        return NULL;
+    }
+    if (size > ALLOCATION_MAXIMUM)
+        return NULL;
+    size_t capacity = region_capacity(ptr);
+    void *resized = resize_region(ptr, size);
+    //a mapping that cannot be resized cannot be moved either, unless tracing kept it from
+    //moving with its mapping
+    if (resized != NULL || (!TRACING && pagemap_get(ptr) == NULL && header_ismapped(HEADER_FROM_REGION(ptr))))
+        return resized;
+    void *moved = allocate_region(size);
+    if (moved == NULL)
+        return NULL;
+    memcpy(moved, ptr, capacity);
+    //between the two, so that the event orders after whatever freed the new region last
+    //and before whatever allocates the old one next
+    if (TRACING)
+        trace_record(TRACE_REALLOC, moved, ptr, size);
+    release_region(ptr);
+    return moved;
+}
+
+//resize a region to hold at least size bytes without copying it, return the region or NULL
+//if it cannot be resized in place; a region with a mapping of its own may move with it
+void *resize_region(void *ptr, size_t size) {
+    slab *slab = pagemap_get(ptr);
+    if (slab != NULL)
+        return size <= slab->size ? ptr : NULL;
+    block_header *header = HEADER_FROM_REGION(ptr);
+    if (header_ismapped(header)) {
+        //grow or shrink the mapping itself, so the contents never have to be copied
+        block_header *remapped = remap_region(header, size);
+        return remapped == NULL ? NULL : REGION_FROM_HEADER(remapped);
+    }
+    //split off the excess, or take in the free right neighbour
+    size_t request = ALIGN(size < ALLOCATION_MINIMUM ? ALLOCATION_MINIMUM : size);
+    heap *heap = header_getheap(header);
+    pthread_mutex_lock(&heap->lock);
+    bool resized = true;
+    if (request <= header_getsize(header))
+        trim(header, request);
+    else
+        resized = expand(header, request);
+    pthread_mutex_unlock(&heap->lock);
+    return resized ? ptr : NULL;
+}
+
+//allocate a zeroed region as mycalloc does without the tracing
+void *allocate_zeroed(size_t count, size_t size) {
+    if (size > 0 && count > SIZE_MAX / size)
+        return NULL;
+    size_t total = count * size;
+    if (total > ALLOCATION_MAXIMUM)
+        return NULL;
+    //looking up the heap first also makes sure MMAP_THRESHOLD has been configured
+    heap *heap = thread_heap();
+    if (total >= MMAP_THRESHOLD) {
+        //a new mapping is already zeroed by the system
+        block_header *header = map_region(total);
+        return header == NULL ? NULL : REGION_FROM_HEADER(header);
+    }
+    if (total > TCACHE_MAXIMUM) {
+        pthread_mutex_lock(&heap->lock);
+        page_header *oldPages = heap->pages;
+        block_header *header = allocate(heap, total);
+        //a region at the start of a page mapped just now has only had its free list
+        //links, and possibly its footer, written to; unless it is the top page, which may
+        //have grown over its old page-end since
+        bool fresh = header != NULL && heap->pages != oldPages && heap->pages != heap->reused
+            && heap->pages != heap->top && header == FIRST_HEADER_FROM_PAGE(heap->pages);
+        pthread_mutex_unlock(&heap->lock);
+        if (header == NULL)
+            return NULL;
+        if (fresh) {
+            memset(REGION_FROM_HEADER(header), 0, sizeof(free_links));
+            *FOOTER_FROM_HEADER(header) = 0;
+        } else {
+            memset(REGION_FROM_HEADER(header), 0, total);
+        }
+        return REGION_FROM_HEADER(header);
+    }
+    void *region = allocate_region(total);
+    if (region != NULL)
+        memset(region, 0, total);
+    return region;
+}
+
+//allocate an aligned region as myaligned_alloc does without the tracing
+void *allocate_aligned_region(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= ALLOCATION_ALIGNMENT)
+        return allocate_region(size);
+    if (size > ALLOCATION_MAXIMUM || alignment > ALLOCATION_MAXIMUM)
+        return NULL;
+    size_t request = ALIGN(size < ALLOCATION_MINIMUM ? ALLOCATION_MINIMUM : size);
+    heap *heap = thread_heap();
+    block_header *header;
+    if (request + alignment >= MMAP_THRESHOLD) {
+        header = map_aligned_region(alignment, request);
+    } else {
+        pthread_mutex_lock(&heap->lock);
+        header = allocate_aligned(heap, alignment, request);
+        pthread_mutex_unlock(&heap->lock);
+    }
+    return header == NULL ? NULL : REGION_FROM_HEADER(header);
+}
+
+/*--- BULK ---*/
+
+/*
+ * A batch of regions is allocated with the heap's lock taken once. Regions of the thread
+ * cache's classes come from the cache first; slab slots are then handed out one after
+ * another, and larger regions are all carved from one free region found by a single
+ * search, which is split up in place. A batch freed together, as allocated, is mostly
+ * made of neighbours: each run of them is merged into one region while still in use, so
+ * that the run is coalesced with its surroundings, and its page released, only once.
+ */
+
+//allocate count regions of size bytes as myalloc_bulk does without the tracing
+size_t allocate_bulk(size_t size, size_t count, void **regions) {
+    //a run of no regions would be a region of negative size
+    if (count == 0 || size > ALLOCATION_MAXIMUM)
+        return 0;
+    //looking up the heap first also makes sure MMAP_THRESHOLD has been configured
+    heap *heap = thread_heap();
+    size_t done = 0;
+    if (size >= MMAP_THRESHOLD) {
+        for (; done < count; done++) {
+            block_header *header = map_region(size);
+            if (header == NULL)
+                break;
+            regions[done] = REGION_FROM_HEADER(header);
+        }
+        return done;
+    }
+    size_t request = size;
+    if (size <= TCACHE_MAXIMUM) {
+        request = size == 0 ? TCACHE_STEP : (size + TCACHE_STEP - 1) & ~(TCACHE_STEP - 1);
+        while (done < count && (regions[done] = tcache_get(request)) != NULL)
+            done++;
+        if (done == count)
+            return done;
+    }
+    pthread_mutex_lock(&heap->lock);
+    if (request <= SLAB_MAXIMUM) {
+        while (done < count && (regions[done] = slab_allocate(heap, request)) != NULL)
+            done++;
+    } else {
+        done += allocate_run(heap, request, count - done, regions + done);
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return done;
+}
+
+//allocate count regions of size bytes by splitting up a single region, or one at a time
+//if there is no region that large; return how many were allocated; the caller must hold
+//the heap's lock
+size_t allocate_run(heap *heap, size_t size, size_t count, void **regions) {
+    size = ALIGN(size < ALLOCATION_MINIMUM ? ALLOCATION_MINIMUM : size);
+    size_t stride = sizeof(block_header) + size;
+    block_header *header = NULL;
+    if (count <= (ALLOCATION_MAXIMUM + sizeof(block_header)) / stride)
+        header = allocate(heap, count * stride - sizeof(block_header));
+    if (header == NULL) {
+        size_t done = 0;
+        for (; done < count; done++) {
+            block_header *single = allocate(heap, size);
+            if (single == NULL)
+                break;
+            regions[done] = REGION_FROM_HEADER(single);
+        }
+        return done;
+    }
+    //each region after the first takes the place of part of the one before; the last
+    //keeps whatever is left over
+    for (size_t i = 0; i + 1 < count; i++) {
+        block_header *next = (void*)header + stride;
+        next->data = 0;
+        header_setheap(next, heap);
+        header_setsize(next, header_getsize(header) - stride);
+        header_setsize(header, size);
+        regions[i] = REGION_FROM_HEADER(header);
+        header = next;
+    }
+    regions[count - 1] = REGION_FROM_HEADER(header);
+    heap->inUse -= (count - 1) * sizeof(block_header);
+    return count;
+}
+
+//free a batch of regions as myfree_bulk does without the tracing
+void release_bulk(void **regions, size_t count) {
+    heap *local = thread_heap();
+    bool locked = false;
+    //neighbouring regions of this thread's heap, merged into one as they are met
+    block_header *run = NULL;
+    //regions of another heap, chained up to be handed back to it in one go
+    heap *remote = NULL;
+    void *first = NULL;
+    void *last = NULL;
+    for (size_t i = 0; i < count; i++) {
+        void *ptr = regions[i];
+        if (ptr == NULL)
+            continue;
+        slab *slab = pagemap_get(ptr);
+        block_header *header = HEADER_FROM_REGION(ptr);
+        if (slab == NULL && header_ismapped(header)) {
+            unmap_region(header);
+            continue;
+        }
+        heap *heap = slab != NULL ? slab->heap : header_getheap(header);
+        size_t size = slab != NULL ? slab->size : header_getsize(header);
+        //the cache takes what it can without having to flush
+        if (size <= TCACHE_MAXIMUM && (NODE_COUNT == 1 || heap->node == local->node)
+                && CACHE.counts[TCACHE_INDEX(size)] + 1 < TCACHE_CAPACITY) {
+            tcache_put(ptr, size);
+            continue;
+        }
+        if (heap != local) {
+            if (heap != remote && remote != NULL)
+                remote_push(remote, first, last);
+            if (heap != remote)
+                first = ptr;
+            else
+                *(void**)last = ptr;
+            remote = heap;
+            last = ptr;
+            continue;
+        }
+        if (!locked) {
+            pthread_mutex_lock(&local->lock);
+            locked = true;
+        }
+        if (slab != NULL) {
+            slab_free(slab, ptr);
+        } else if (run != NULL && header_next(run) == header) {
+            //the run takes in the region, header and all
+            header_setsize(run, header_getsize(run) + sizeof(block_header) + header_getsize(header));
+            local->inUse += sizeof(block_header);
+        } else if (run != NULL && header_next(header) == run) {
+            header_setsize(header, header_getsize(header) + sizeof(block_header) + header_getsize(run));
+            local->inUse += sizeof(block_header);
+            run = header;
+        } else {
+            if (run != NULL)
+                release(run);
+            run = header;
+        }
+    }
+    if (run != NULL)
+        release(run);
+    if (locked)
+        pthread_mutex_unlock(&local->lock);
+    if (remote != NULL)
+        remote_push(remote, first, last);
+}
+
+/*--- HARDENING ---*/
+
+//return whether hardened mode is on, setting up the heaps first if they are not yet,
+//since it is only known once they are
+bool hardened() {
+    if (THREAD_HEAP == NULL)
+        thread_heap();
+    return HARDENED;
+}
+
+void *guard_allocate(size_t size) {
+    if (size > ALLOCATION_MAXIMUM - GUARD_SIZE)
+        return NULL;
+    return guard_seal(allocate_region(size + GUARD_SIZE));
+}
+
+void guard_release(void *ptr) {
+    if (ptr == NULL)
+        return;
+    size_t capacity = guard_check(ptr);
+    uintptr_t *canary = ptr + capacity - GUARD_SIZE;
+    *canary = CANARY_FREED(canary);
+    quarantine_put(ptr, capacity);
+}
+
+void *guard_reallocate(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return guard_allocate(size);
+    if (size == 0) {
+        if (TRACING)
+            trace_record(TRACE_REALLOC, NULL, ptr, 0);
+        guard_release(ptr);
+        return NULL;
+    }
+    size_t usable = guard_check(ptr) - GUARD_SIZE;
+    if (size > ALLOCATION_MAXIMUM - GUARD_SIZE)
+        return NULL;
+    void *resized = resize_region(ptr, size + GUARD_SIZE);
+    if (resized != NULL)
+        return guard_seal(resized);
+    //the old region is freed as any other, so it is quarantined too
+    void *moved = guard_allocate(size);
+    if (moved == NULL)
+        return NULL;
+    memcpy(moved, ptr, usable < size ? usable : size);
+    if (TRACING)
+        trace_record(TRACE_REALLOC, moved, ptr, size);
+    guard_release(ptr);
+    return moved;
+}
+
+void *guard_zeroed(size_t count, size_t size) {
+    if (size > 0 && count > SIZE_MAX / size)
+        return NULL;
+    if (count * size > ALLOCATION_MAXIMUM - GUARD_SIZE)
+        return NULL;
+    return guard_seal(allocate_zeroed(count * size + GUARD_SIZE, 1));
+}
+
+void *guard_aligned(size_t alignment, size_t size) {
+    if (size > ALLOCATION_MAXIMUM - GUARD_SIZE)
+        return NULL;
+    return guard_seal(allocate_aligned_region(alignment, size + GUARD_SIZE));
+}
+
+size_t guard_bulk(size_t size, size_t count, void **regions) {
+    if (count == 0 || size > ALLOCATION_MAXIMUM - GUARD_SIZE)
+        return 0;
+    size_t allocated = allocate_bulk(size + GUARD_SIZE, count, regions);
+    for (size_t i = 0; i < allocated; i++)
+        guard_seal(regions[i]);
+    return allocated;
+}
+
+void guard_release_bulk(void **regions, size_t count) {
+    for (size_t i = 0; i < count; i++)
+        guard_release(regions[i]);
+}
+
+//write the canary at the end of a region, return the region
+void *guard_seal(void *region) {
+    if (region != NULL) {
+        uintptr_t *canary = region + region_capacity(region) - GUARD_SIZE;
+        *canary = CANARY(canary);
+    }
+    return region;
+}
+
+//check that region was handed out and not freed since, and that its canary is intact,
+//aborting otherwise; return its capacity
+size_t guard_check(void *region) {
+    if ((uintptr_t)region % ALLOCATION_ALIGNMENT != 0)
+        guard_fail("invalid pointer", region);
+    slab *slab = pagemap_get(region);
+    size_t capacity;
+    if (slab != NULL) {
+        if ((region - (void*)slab - SLAB_SLOTS_OFFSET) % slab->size != 0 || region >= slab->unused)
+            guard_fail("invalid pointer", region);
+        capacity = slab->size;
+    } else {
+        block_header *header = HEADER_FROM_REGION(region);
+        if (header_isfree(header))
+            guard_fail("double free", region);
+        //sizes are 8 short of a multiple of 16, but for mappings, which run to a page end
+        capacity = header_getsize(header);
+        if (header_isend(header) || capacity < ALLOCATION_MINIMUM
+                || capacity % ALLOCATION_ALIGNMENT != (header_ismapped(header) ? 0 : sizeof(block_header))
+                || (!header_ismapped(header) && header_getheap(header)->index >= HEAP_COUNT))
+            guard_fail("invalid pointer", region);
+    }
+    //a single compare for the region that is fine, telling what went wrong can wait
+    uintptr_t *canary = region + capacity - GUARD_SIZE;
+    if (__builtin_expect(*canary != CANARY(canary), false)) {
+        if (*canary == CANARY_FREED(canary))
+            guard_fail("double free", region);
+        guard_fail("overflow past the end of the region, or invalid pointer", region);
+    }
+    return capacity;
+}
+
+//report misuse of the heap found at region, and abort
+void guard_fail(const char *problem, void *region) {
+    //nothing that might allocate, the heap may be in no state for it
+    char message[128];
+    int length = snprintf(message, sizeof(message), "myalloc: %s at %p\n", problem, region);
+    write(STDERR_FILENO, message, length);
+    abort();
+}
+
+//hold a freed region of the given capacity in the calling thread's quarantine, releasing
+//the oldest regions to make room for it
+void quarantine_put(void *region, size_t capacity) {
+    if (capacity > QUARANTINE_LIMIT) {
+        release_region(region);
+        return;
+    }
+    tcache_register();
+    if (CACHE.quarantineCount == QUARANTINE_SLOTS || CACHE.quarantineBytes + capacity > QUARANTINE_LIMIT)
+        quarantine_evict(&CACHE, capacity);
+    unsigned int slot = (CACHE.quarantineHead + CACHE.quarantineCount++) % QUARANTINE_SLOTS;
+    CACHE.quarantine[slot] = region;
+    CACHE.quarantineCapacities[slot] = capacity;
+    CACHE.quarantineBytes += capacity;
+}
+
+//release a batch of the oldest regions of a thread's quarantine, and more until room more
+//bytes fit in it, checking their canaries were not written to
+void quarantine_evict(tcache *cache, size_t room) {
+    //releasing them together takes each heap's lock once for the lot, rather than once
+    //for every region the thread cache has no room for
+    void *batch[QUARANTINE_BATCH];
+    unsigned int count = 0;
+    unsigned int evicted = 0;
+    while (cache->quarantineCount > 0
+            && (evicted < QUARANTINE_BATCH || cache->quarantineBytes + room > QUARANTINE_LIMIT)) {
+        void *region = cache->quarantine[cache->quarantineHead];
+        size_t capacity = cache->quarantineCapacities[cache->quarantineHead];
+        cache->quarantineHead = (cache->quarantineHead + 1) % QUARANTINE_SLOTS;
+        cache->quarantineCount--;
+        cache->quarantineBytes -= capacity;
+        uintptr_t *canary = region + capacity - GUARD_SIZE;
+        if (*canary != CANARY_FREED(canary))
+            guard_fail("write after free", region);
+        evicted++;
+        //its capacity is known, so a small region goes straight to the cache if it has room
+        if (capacity <= TCACHE_MAXIMUM && capacity < MMAP_THRESHOLD && NODE_COUNT == 1
+                && cache->counts[TCACHE_INDEX(capacity)] + 1 < TCACHE_CAPACITY) {
+            tcache_put(region, capacity);
+            continue;
+        }
+        batch[count++] = region;
+        if (count == QUARANTINE_BATCH) {
+            release_bulk(batch, count);
+            count = 0;
+        }
+    }
+    release_bulk(batch, count);
+}
+
+/*--- OTHER FUNCTIONS ---*/
+
+//allocate new heap space with an added header, size is clamped between
+//ALLOCATION_MINIMUM and ALLOCATION_MAXIMUM inclusive; return NULL if out of memory
+//the caller must hold the heap's lock
+block_header *allocate(heap *heap, size_t size) {
+    remote_drain(heap);
+    if (heap->pages == NULL)
+        init(heap);
+    if (heap->pages == NULL)
+        return NULL;
+    block_header *header = place_region(heap, size);
+    if (header != NULL)
+        heap->inUse += header_getsize(header);
+    return header;
+}
+
+//allocate a region of exactly size bytes, from a slab if small enough, or NULL if
+//out of memory; the caller must hold the heap's lock
+void *allocate_small(heap *heap, unsigned int size) {
+    if (size <= SLAB_MAXIMUM)
+        return slab_allocate(heap, size);
+    block_header *header = allocate(heap, size);
+    return header == NULL ? NULL : REGION_FROM_HEADER(header);
+}
+
+//return an in-use region to its heap, coalescing it and releasing its page if empty
+//the caller must hold the lock of the heap owning the region
+void release(block_header *header) {
+    heap *heap = header_getheap(header);
+    heap->inUse -= header_getsize(header);
+    //mark the region as "not being used", but leave deallocation up to the coalescing function
+    header_setfree(header, true);
+    bin_insert(header);
+    //merge with the free neighbours on either side, the left one absorbs this region
+    coalesce(header);
+    if (header_isprevfree(header))
+        header = coalesce(header_prev(header));
+    //free space left in the middle of pages is otherwise never given back, so the region
+    //just coalesced is; one ending its page is left to clean, which gives the page up or
+    //shrinks it. Only looking once something large is free keeps the clock off the path
+    //of most frees, and the rest of the heap is left to myalloc_trim
+    if (header_getsize(header) >= TRIM_MINIMUM && !header_isend(header_next(header))
+            && TRIM_MS > 0 && now_ms() - heap->trimmed >= TRIM_MS) {
+        heap->trimmed = now_ms();
+        purge_range(LINKS_FROM_HEADER(header) + 1, FOOTER_FROM_HEADER(header));
+    }
+    clean(header);
+}
+
+//set up the page chain of an empty heap
+void init(heap *heap) {
+    page_header *page = reserve_init(heap) ? heap->top : page_acquire(heap, 1);
+    if (page == NULL)
+        return;
+    heap->pages = page;
+    heap->trimmed = now_ms();
+    header_setheap(FIRST_HEADER_FROM_PAGE(page), heap);
+    bin_insert(FIRST_HEADER_FROM_PAGE(page));
+}
+
+//set up the heaps and their locks, once per process
+void heaps_init() {
+    char *arenas = getenv("MYALLOC_ARENAS");
+    long count = arenas != NULL ? atol(arenas) : sysconf(_SC_NPROCESSORS_ONLN);
+    HEAP_COUNT = count < 1 ? 1 : count > MAX_HEAPS ? MAX_HEAPS : count;
+    char *threshold = getenv("MYALLOC_MMAP_THRESHOLD");
+    if (threshold != NULL && atol(threshold) > 0)
+        MMAP_THRESHOLD = atol(threshold);
+    char *retain = getenv("MYALLOC_RETAIN");
+    if (retain != NULL && atol(retain) >= 0)
+        RETAIN_LIMIT = atol(retain);
+    char *decay = getenv("MYALLOC_DECAY_MS");
+    if (decay != NULL && atol(decay) >= 0)
+        DECAY_MS = atol(decay);
+    char *trimMs = getenv("MYALLOC_TRIM_MS");
+    if (trimMs != NULL && atol(trimMs) >= 0)
+        TRIM_MS = atol(trimMs);
+    char *reserve = getenv("MYALLOC_RESERVE");
+    if (reserve != NULL && atol(reserve) >= 0)
+        RESERVE_SIZE = atol(reserve);
+    char *policy = getenv("MYALLOC_POLICY");
+    for (int i = 0; policy != NULL && i <= MYALLOC_BEST_FIT; i++) {
+        if (strcmp(policy, POLICY_NAMES[i]) == 0)
+            POLICY = i;
+    }
+    char *numa = getenv("MYALLOC_NUMA");
+    char *fake = getenv("MYALLOC_NUMA_FAKE");
+    if ((numa != NULL && strcmp(numa, "on") == 0) || (fake != NULL && atol(fake) > 0)) {
+        SYSTEM_NODES = numa_nodes();
+        FAKE_NODES = fake != NULL && atol(fake) > 0;
+        long nodes = FAKE_NODES ? atol(fake) : SYSTEM_NODES;
+        NODE_COUNT = nodes > MAX_HEAPS ? MAX_HEAPS : nodes;
+        //every node needs as many heaps as the others, and at least one
+        if (HEAP_COUNT < NODE_COUNT)
+            HEAP_COUNT = NODE_COUNT;
+        HEAP_COUNT = HEAP_COUNT / NODE_COUNT * NODE_COUNT;
+    }
+    char *huge = getenv("MYALLOC_HUGEPAGES");
+    HUGE_PAGES = huge != NULL && (strcmp(huge, "thp") == 0 || strcmp(huge, "hugetlb") == 0);
+    HUGETLB = huge != NULL && strcmp(huge, "hugetlb") == 0;
+    char *hardened = getenv("MYALLOC_HARDENED");
+    HARDENED = hardened != NULL && strcmp(hardened, "on") == 0;
+    char *quarantine = getenv("MYALLOC_QUARANTINE");
+    if (quarantine != NULL && atol(quarantine) >= 0)
+        QUARANTINE_LIMIT = atol(quarantine);
+    if (HARDENED && syscall(SYS_getrandom, &GUARD_SECRET, sizeof(GUARD_SECRET), 0) != sizeof(GUARD_SECRET))
+        GUARD_SECRET = now_ns() ^ (uintptr_t)&GUARD_SECRET;
+    char *trace = getenv("MYALLOC_TRACE");
+    char *traceSize = getenv("MYALLOC_TRACE_SIZE");
+    if (trace != NULL)
+        trace_init(trace, traceSize != NULL && atol(traceSize) > 0 ? atol(traceSize) : TRACE_DEFAULT_SIZE);
+    char *profile = getenv("MYALLOC_PROFILE");
+    char *profileRate = getenv("MYALLOC_PROFILE_RATE");
+    if (profile != NULL || (profileRate != NULL && atol(profileRate) > 0))
+        profile_init(profileRate != NULL && atol(profileRate) > 0 ? atol(profileRate) : PROFILE_DEFAULT_RATE, profile);
+    for (int i = 0; i < MAX_HEAPS; i++) {
+        pthread_mutex_init(&HEAPS[i].lock, NULL);
+        HEAPS[i].index = i;
+        HEAPS[i].node = i % NODE_COUNT;
+    }
+}
+
+/*
+ * A child process only has the thread that forked, so a heap locked by any other thread
+ * at the time would stay locked in the child forever. Every heap is locked around the
+ * fork instead, in index order; no thread ever holds two heaps' locks at once, so this
+ * cannot deadlock. Registering the handlers may itself allocate, so it happens from a
+ * constructor rather than from heaps_init, which must not.
+ */
+__attribute__((constructor))
+static void heaps_register_fork() {
+    pthread_atfork(heaps_prefork, heaps_postfork_parent, heaps_postfork_child);
+}
+
+//lock every heap, and the profiler's tables, ahead of a fork
+void heaps_prefork() {
+    pthread_once(&HEAPS_ONCE, heaps_init);
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        pthread_mutex_lock(&HEAPS[i].lock);
+    pthread_mutex_lock(&PROFILE_LOCK);
+}
+
+//release every heap, and the profiler's tables, in the parent after a fork
+void heaps_postfork_parent() {
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        pthread_mutex_unlock(&HEAPS[i].lock);
+    pthread_mutex_unlock(&PROFILE_LOCK);
+}
+
+//release every heap in the child after a fork, where the locks are owned by a thread
+//that no longer exists, so they are set up afresh
+void heaps_postfork_child() {
+    for (unsigned int i = 0; i < HEAP_COUNT; i++)
+        pthread_mutex_init(&HEAPS[i].lock, NULL);
+    pthread_mutex_init(&PROFILE_LOCK, NULL);
+    //the trace file is shared with the parent, which goes on writing it
+    TRACING = false;
+}
+
+//return the heap assigned to the calling thread, assigning one if it has none yet
+heap *thread_heap() {
+    if (THREAD_HEAP == NULL) {
+        pthread_once(&HEAPS_ONCE, heaps_init);
+        //round-robin among the heaps of the thread's node
+        unsigned int node = NODE_COUNT > 1 ? thread_node() : 0;
+        unsigned int next = __atomic_fetch_add(&NEXT_HEAP[node], 1, __ATOMIC_RELAXED);
+        THREAD_HEAP = &HEAPS[node + next % (HEAP_COUNT / NODE_COUNT) * NODE_COUNT];
+    }
+    return THREAD_HEAP;
+}
+
+//return the NUMA node a newly seen thread belongs to
+unsigned int thread_node() {
+    if (FAKE_NODES)
+        return __atomic_fetch_add(&NEXT_NODE, 1, __ATOMIC_RELAXED) % NODE_COUNT;
+    //the node the thread runs on now; should it move later, its memory stays behind
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return 0;
+    return node % NODE_COUNT;
+}
+
+//read the number of NUMA nodes of the system, 1 if it cannot be told
+unsigned int numa_nodes() {
+    //a list of node ranges such as "0-3", the last of which is the highest node; read
+    //without stdio, which would allocate
+    char list[256];
+    int fd = open("/sys/devices/system/node/online", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 1;
+    ssize_t length = read(fd, list, sizeof(list) - 1);
+    close(fd);
+    if (length <= 0)
+        return 1;
+    list[length] = '\0';
+    char *last = list;
+    for (char *c = list; *c != '\0'; c++) {
+        if (*c == ',' || *c == '-')
+            last = c + 1;
+    }
+    return atol(last) + 1;
+}
+
+//prefer the given node for the memory of a mapping, if NUMA awareness is enabled
+void numa_bind(void *base, size_t size, unsigned int node) {
+    if (NODE_COUNT == 1)
+        return;
+    //preferred rather than bound, so that a full node spills over to the others
+    //instead of failing the allocation
+    unsigned long mask = 1UL << (node % SYSTEM_NODES % (sizeof(mask) * CHAR_BIT));
+    syscall(SYS_mbind, base, size, MPOL_PREFERRED, &mask, sizeof(mask) * CHAR_BIT, 0);
+}
+
+/*
+ * Allocate n pages-worth of heap space, return a pointer to the beginning of the
+ * page as a page header. The block header following it initially represents the
+ * whole page as a free region, and has its page-start-bit set.
+ * A header is also placed at the end of the page, with page-end-bit set to 1, and a size
+ * of its offset from the page header; this header will always be "in-use" internally.
+ * If n is 0, NULL is returned.
+ */
+page_header *allocatePage(unsigned int n, unsigned int node) {
+    if (n == 0)
+        return NULL;
+    //with huge pages, the rest of the last one becomes part of the free region
+    size_t size = ((size_t)n * getpagesize() + PAGE_GRANULE - 1) & ~(PAGE_GRANULE - 1);
+    //printf("allocating new page of memory, size %lu\n", size);
+    void *alloc = map_pages(size, node);
+    if (alloc == MAP_FAILED) {
+        perror("myalloc MMAP error:");
+        return NULL;
+    }
+    __atomic_fetch_add(&MMAP_COUNT, 1, __ATOMIC_RELAXED);
+    return page_layout(alloc, size);
+}
+
+//map size bytes for heap pages, a multiple of PAGE_GRANULE, backed by huge pages if
+//they are enabled and bound to the given NUMA node; return MAP_FAILED on failure
+void *map_pages(size_t size, unsigned int node) {
+    int prot = PROT_READ | PROT_WRITE | PROT_EXEC;
+    //bound before anything is written, which would place the first page
+    if (!HUGE_PAGES) {
+        void *base = mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base != MAP_FAILED)
+            numa_bind(base, size, node);
+        return base;
+    }
+    if (HUGETLB) {
+        void *base = mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) {
+            numa_bind(base, size, node);
+            return base;
+        }
+    }
+    //transparent huge pages only back huge page aligned memory
+    void *base = map_aligned(size, prot, MAP_PRIVATE | MAP_ANONYMOUS);
+    if (base == MAP_FAILED)
+        return MAP_FAILED;
+    madvise(base, size, MADV_HUGEPAGE);
+    numa_bind(base, size, node);
+    return base;
+}
+
+//map size bytes at a huge page aligned address, return MAP_FAILED on failure
+void *map_aligned(size_t size, int prot, int flags) {
+    //map an extra huge page and trim the mapping down to an aligned one
+    void *base = mmap(NULL, size + HUGE_PAGE_SIZE, prot, flags, -1, 0);
+    if (base == MAP_FAILED)
+        return MAP_FAILED;
+    uintptr_t start = ((uintptr_t)base + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (start > (uintptr_t)base)
+        munmap(base, start - (uintptr_t)base);
+    if (start + size < (uintptr_t)base + size + HUGE_PAGE_SIZE)
+        munmap((void*)(start + size), (uintptr_t)base + HUGE_PAGE_SIZE - start);
+    return (void*)start;
+}
+
+//lay out a mapping of size bytes as a page holding a single free region, as allocatePage does
+page_header *page_layout(void *base, size_t size) {
+    page_header *page = (page_header*) base;
+    page->next = NULL;
+    page->prev = NULL;
+    page->size = size;
+    block_header *pageRoot = FIRST_HEADER_FROM_PAGE(page);
+    block_header *pageFooter = (void *)page + (size - sizeof(block_header));
+    pageFooter->data = 0;
+    header_setend(pageFooter, true);
+    header_setsize(pageFooter, size - sizeof(block_header));
+    pageRoot->data = 0;
+    header_setstart(pageRoot, true);
+    header_setfree(pageRoot, true);
+    header_setsize(pageRoot, (void*)pageFooter - REGION_FROM_HEADER(pageRoot));
+    return page;
+}
+
+//return pointer to heap space in a free region that can support a block allocation
+//of the specified size, found by the placement policy
+block_header *place_region(heap *heap, size_t size) {
+    if (size < ALLOCATION_MINIMUM)
+        size = ALLOCATION_MINIMUM;
+    size = ALIGN(size);
+    block_header *header = bin_find(heap, size);
+    if (header == NULL) {
+        //no fit could be found, allocate new space
+        return append_region(heap, size);
+    }
+    if (divide(header, size) == NULL) {
+        //the region is not big enough to be split, but is still big enough to hold
+        //the requested size; return the header, with no alterations to size
+        bin_remove(header);
+        header_setfree(header, false);
+    }
+    return header;
+}
+
+//append a new region at the end of the top page, grown into the heap's reservation, or
+//failing that in a new page, which becomes the head of the heap's page list
+block_header *append_region(heap *heap, size_t size) {
+    block_header *header = top_grow(heap, size);
+    if (header == NULL) {
+        //the page(s) must have room for the region as well as the page header and the page-end
+        size_t pages = (size + sizeof(page_header) + 2 * sizeof(block_header) + getpagesize() - 1) / getpagesize();
+        if (pages > UINT_MAX)
+            return NULL;
+        page_header *page = page_acquire(heap, pages);
+        if (page == NULL)
+            return NULL;
+        page->next = heap->pages;
+        if (heap->pages != NULL)
+            heap->pages->prev = page;
+        heap->pages = page;
+        header = FIRST_HEADER_FROM_PAGE(page);
+        header_setheap(header, heap);
+        bin_insert(header);
+    }
+    if (divide(header, size) == NULL) {
+        //the remainder is too small to become a region of its own
+        bin_remove(header);
+        header_setfree(header, false);
+    }
+    return header;
+}
+
+//divide a region into two, based on size, updating the necessary header pointers
+//the first region ends up in-use, the second free
+//return a the passed header, or NULL if the region could not be divided
+block_header *divide(block_header *header, size_t size) {
+    //if the passed header was null, was a page-end, or doesn't have room for a
+    //second header and a minimal region; return null
+    if (header == NULL || header_isend(header)
+            || header_getsize(header) < size + sizeof(block_header) + ALLOCATION_MINIMUM)
+        return NULL;
+    if (header_isfree(header))
+        bin_remove(header);
+    block_header *middle = REGION_FROM_HEADER(header) + size;
+    block_header *next = header_next(header);
+    header_setsize(header, ((void*)middle) - ((void*)REGION_FROM_HEADER(header)));
+    middle->data = 0;
+    header_setheap(middle, header_getheap(header));
+    header_setsize(middle, ((void*)next) - ((void*)REGION_FROM_HEADER(middle)));
+    header_setfree(header, false);
+    header_setfree(middle, true);
+    bin_insert(middle);
+    return header;
+}
+
+//shrink an in-use region to size bytes, returning what is left over to the heap if it
+//is enough for a region of its own; the caller must hold the region's heap's lock
+void trim(block_header *header, size_t size) {
+    size_t oldSize = header_getsize(header);
+    //the split off remainder may border another free region
+    if (divide(header, size) != NULL) {
+        header_getheap(header)->inUse -= oldSize - header_getsize(header);
+        coalesce(header_next(header));
+    }
+}
+
+//grow an in-use region to at least size bytes by absorbing a free right neighbour,
+//return false if there is no room to; the caller must hold the region's heap's lock
+bool expand(block_header *header, size_t size) {
+    heap *heap = header_getheap(header);
+    block_header *right = header_next(header);
+    block_header *end = header_isfree(right) && !header_isend(right) ? header_next(right) : right;
+    //a region at the end of the top page grows into the heap's reservation instead of moving
+    if (header_isend(end) && PAGE_FROM_END(end) == heap->top && header_getsize(header) < size) {
+        top_grow(heap, size - header_getsize(header));
+        right = header_next(header);
+    }
+    if (!header_isfree(right) || header_isend(right)
+            || header_getsize(header) + sizeof(block_header) + header_getsize(right) < size)
+        return false;
+    bin_remove(right);
+    heap->inUse += sizeof(block_header) + header_getsize(right);
+    header_setsize(header, header_getsize(header) + sizeof(block_header) + header_getsize(right));
+    trim(header, size);
+    return true;
+}
+
+//allocate a region of size bytes whose address is a multiple of alignment, by
+//splitting the misaligned front off a larger region; the caller must hold the heap's lock
+block_header *allocate_aligned(heap *heap, size_t alignment, size_t size) {
+    //enough for the region, plus a front part that can be a region of its own
+    block_header *header = allocate(heap, size + alignment + sizeof(block_header) + ALLOCATION_MINIMUM);
+    if (header == NULL)
+        return NULL;
+    uintptr_t region = (uintptr_t)REGION_FROM_HEADER(header);
+    if (region % alignment != 0) {
+        //the front part needs room for its own header and a minimal region
+        uintptr_t aligned = (region + sizeof(block_header) + ALLOCATION_MINIMUM + alignment - 1) & ~((uintptr_t)alignment - 1);
+        //alignments are multiples of 16, so the front keeps the next region aligned
+        block_header *front = header;
+        header = HEADER_FROM_REGION(aligned);
+        header->data = 0;
+        header_setheap(header, heap);
+        header_setsize(header, (void*)header_next(front) - REGION_FROM_HEADER(header));
+        header_setsize(front, (void*)header - REGION_FROM_HEADER(front));
+        //the front goes back to the heap, possibly merging into its left neighbour; its
+        //size is accounted for there, but the new header is not
+        heap->inUse -= sizeof(block_header);
+        release(front);
+    }
+    trim(header, size);
+    return header;
+}
+
+//coalesce this region and the region to its right
+//return NULL if header is NULL, non-free or is a page-end
+//if the region on the right is NULL, non-free or is a page end then nothing will change
+//return the header of the combined region
+block_header *coalesce(block_header *header) {
+    if (header == NULL || !header_isfree(header) || header_isend(header))
+        return NULL;
+    block_header *right = header_next(header);
+    if (!header_isfree(right) || header_isend(right))
+        return header;
+    //safe to combine
+    //printf("coalescing regions %p and %p\n", (void*)header, (void*)right);
+    bin_remove(header);
+    bin_remove(right);
+    header_setsize(header, header_getsize(header) + sizeof(block_header) + header_getsize(right));
+    bin_insert(header);
+    return header;
+}
+
+//deallocate the page(s) holding header, if header is a free region spanning all of them,
+//or give back the free end of the top page
+void clean(block_header *header) {
+    if (header == NULL || !header_isfree(header) || !header_isend(header_next(header)))
+        return;
+    heap *heap = header_getheap(header);
+    //the top page is never given up, only shrunk back into its reservation
+    if (PAGE_FROM_END(header_next(header)) == heap->top) {
+        top_trim(heap, header);
+        return;
+    }
+    if (!header_isstart(header))
+        return;
+    page_header *page = PAGE_FROM_FIRST_HEADER(header);
+    //always keep the last page around, so the heap never has to be rebuilt
+    if (page->prev == NULL && page->next == NULL)
+        return;
+    //remove the page from the linked list
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        //this must be the head if the previous pointer is null
+        assert(page == heap->pages);
+        heap->pages = page->next;
+    }
+    if (page->next != NULL)
+        page->next->prev = page->prev;
+    //keep its space around for the next page the heap needs
+    bin_remove(header);
+    //printf("found empty page %p of %zu bytes; retaining\n", (void*)page, page->size);
+    page_retain(heap, page, page->size);
+}
+
+/*--- PAGE RETENTION ---*/
+
+//return n pages-worth of heap space, reusing a retained page if one fits, laid out as
+//allocatePage does; the caller must hold the heap's lock
+page_header *page_acquire(heap *heap, unsigned int n) {
+    page_decay(heap);
+    heap->reused = NULL;
+    size_t size = ((size_t)n * getpagesize() + PAGE_GRANULE - 1) & ~(PAGE_GRANULE - 1);
+    int best = -1;
+    for (int i = 0; i < heap->retainedCount; i++) {
+        //a page much larger than needed is kept for a request that makes better use of it
+        size_t retained = heap->retained[i].size;
+        if (retained >= size && retained / 2 <= size
+                && (best < 0 || retained < heap->retained[best].size))
+            best = i;
+    }
+    if (best < 0) {
+        page_header *page = allocatePage(n, heap->node);
+        if (page != NULL)
+            heap->mapped += size;
+        return page;
+    }
+    retained_page page = heap->retained[best];
+    heap->retainedCount--;
+    memmove(&heap->retained[best], &heap->retained[best + 1], (heap->retainedCount - best) * sizeof(retained_page));
+    if (!page.purged)
+        heap->retainedBytes -= page.size;
+    page_header *result = page_layout(page.base, page.size);
+    if (!page.purged)
+        heap->reused = result;
+    return result;
+}
+
+//keep an empty mapping of size bytes for reuse instead of unmapping it; the caller must
+//hold the heap's lock
+void page_retain(heap *heap, void *base, size_t size) {
+    if (heap->retainedCount == RETAIN_SLOTS) {
+        //make room by giving up the oldest page altogether
+        retained_page *oldest = &heap->retained[0];
+        if (!oldest->purged)
+            heap->retainedBytes -= oldest->size;
+        munmap(oldest->base, oldest->size);
+        __atomic_fetch_add(&MUNMAP_COUNT, 1, __ATOMIC_RELAXED);
+        heap->mapped -= oldest->size;
+        heap->retainedCount--;
+        memmove(oldest, oldest + 1, heap->retainedCount * sizeof(retained_page));
+    }
+    retained_page *page = &heap->retained[heap->retainedCount++];
+    page->base = base;
+    page->size = size;
+    page->since = now_ms();
+    page->purged = false;
+    heap->retainedBytes += size;
+    page_decay(heap);
+}
+
+//hand the memory of retained pages back to the system once they have been held too
+//long, or too much of it is held; the caller must hold the heap's lock
+void page_decay(heap *heap) {
+    unsigned long now = now_ms();
+    //the oldest pages come first, and are the first to go
+    for (int i = 0; i < heap->retainedCount; i++) {
+        retained_page *page = &heap->retained[i];
+        if (page->purged)
+            continue;
+        if (heap->retainedBytes <= RETAIN_LIMIT && now - page->since < DECAY_MS)
+            break;
+        madvise(page->base, page->size, MADV_DONTNEED);
+        page->purged = true;
+        heap->retainedBytes -= page->size;
+    }
+}
+
+/*
+ * A page is only given up once it is empty, so a heap whose pages each hold a few
+ * long-lived regions keeps all of them, and the free space between those regions stays
+ * resident however much of it there is. Trimming walks the heap's pages and hands the
+ * memory of every whole granule inside a free region back with madvise, keeping only the
+ * links at its start and the footer at its end, which the heap still reads; the range
+ * stays mapped, and reads as zero when next touched. Empty slabs start over from their
+ * first slot, as their chain of free slots is lost, and retained pages are purged before
+ * their time. This is done by myalloc_trim. The heaps themselves only do it for a single
+ * region, at most once every TRIM_MS, as a free leaves a large region free in the middle
+ * of a page, so that freeing never costs more than the size of what it freed.
+ */
+
+//hand the memory of the heap's free space back to the system, return how many bytes of it
+//were resident; the caller must hold the heap's lock
+size_t heap_trim(heap *heap) {
+    heap->trimmed = now_ms();
+    size_t released = 0;
+    for (page_header *page = heap->pages; page != NULL; page = page->next) {
+        for (block_header *header = FIRST_HEADER_FROM_PAGE(page); !header_isend(header); header = header_next(header)) {
+            if (header_isfree(header))
+                released += purge_range(LINKS_FROM_HEADER(header) + 1, FOOTER_FROM_HEADER(header));
+        }
+    }
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+        for (slab *slab = heap->slabs[i]; slab != NULL; slab = slab->next) {
+            if (slab->used > 0)
+                continue;
+            slab->free = NULL;
+            slab->unused = (void*)slab + SLAB_SLOTS_OFFSET;
+            released += purge_range(slab->unused, (void*)slab + slab->span);
+        }
+    }
+    for (int i = 0; i < heap->retainedCount; i++) {
+        retained_page *page = &heap->retained[i];
+        if (page->purged)
+            continue;
+        released += purge_range(page->base, page->base + page->size);
+        page->purged = true;
+        heap->retainedBytes -= page->size;
+    }
+    return released;
+}
+
+//hand the whole granules between start and end back to the system, return how many bytes
+//of them were resident
+size_t purge_range(void *start, void *end) {
+    void *first = (void*)(((uintptr_t)start + PAGE_GRANULE - 1) & ~(PAGE_GRANULE - 1));
+    void *last = (void*)((uintptr_t)end & ~(PAGE_GRANULE - 1));
+    if (last <= first)
+        return 0;
+    //a range purged before is usually still untouched, and costs no more than a look
+    size_t released = resident_bytes(first, last - first);
+    if (released > 0)
+        madvise(first, last - first, MADV_DONTNEED);
+    return released;
+}
+
+//return how many bytes of the size bytes at base, a whole number of pages, are resident
+size_t resident_bytes(void *base, size_t size) {
+    unsigned char pages[256];
+    size_t pageSize = getpagesize();
+    size_t span = sizeof(pages) * pageSize;
+    size_t resident = 0;
+    for (size_t offset = 0; offset < size; offset += span) {
+        size_t length = size - offset < span ? size - offset : span;
+        //if it cannot be told, the range is taken to be resident
+        if (mincore(base + offset, length, pages) != 0)
+            return size;
+        for (size_t i = 0; i < length / pageSize; i++)
+            resident += (pages[i] & 1) * pageSize;
+    }
+    return resident;
+}
+
+//return the time of the monotonic clock in milliseconds
+unsigned long now_ms() {
+    return now_ns() / 1000000;
+}
+
+//return the time of the monotonic clock in nanoseconds
+unsigned long now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000UL + time.tv_nsec;
+}
+
+/*--- RESERVATION ---*/
+
+//reserve the range of address space the heap's top page grows into, and commit its first
+//page; return false if the heap cannot have a reservation
+bool reserve_init(heap *heap) {
+    //huge pages from the system's pool cannot be committed a part at a time
+    if (RESERVE_SIZE == 0 || HUGETLB)
+        return false;
+    size_t size = (RESERVE_SIZE + PAGE_GRANULE - 1) & ~(PAGE_GRANULE - 1);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    void *base = HUGE_PAGES ? map_aligned(size, PROT_NONE, flags) : mmap(NULL, size, PROT_NONE, flags, -1, 0);
+    if (base == MAP_FAILED)
+        return false;
+    __atomic_fetch_add(&MMAP_COUNT, 1, __ATOMIC_RELAXED);
+    //whatever gets committed later keeps these
+    if (HUGE_PAGES)
+        madvise(base, size, MADV_HUGEPAGE);
+    numa_bind(base, size, heap->node);
+    heap->reserveTop = base;
+    heap->reserveEnd = base + size;
+    if (reserve_commit(heap, PAGE_GRANULE) == NULL) {
+        munmap(base, size);
+        heap->reserveTop = NULL;
+        heap->reserveEnd = NULL;
+        return false;
+    }
+    heap->top = page_layout(base, PAGE_GRANULE);
+    return true;
+}
+
+//commit size more bytes of the heap's reservation, a multiple of PAGE_GRANULE, return where
+//they start or NULL if the reservation is used up
+void *reserve_commit(heap *heap, size_t size) {
+    void *base = heap->reserveTop;
+    if (base == NULL || size > (size_t)(heap->reserveEnd - base))
+        return NULL;
+    if (mprotect(base, size, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+        return NULL;
+    heap->reserveTop += size;
+    heap->mapped += size;
+    return base;
+}
+
+//hand the last size bytes committed of the heap's reservation back to the system
+void reserve_decommit(heap *heap, size_t size) {
+    heap->reserveTop -= size;
+    heap->mapped -= size;
+    madvise(heap->reserveTop, size, MADV_DONTNEED);
+    mprotect(heap->reserveTop, size, PROT_NONE);
+}
+
+//grow the heap's top page until the free region ending it holds at least size bytes, return
+//that region, or NULL if the reservation is used up; the caller must hold the heap's lock
+block_header *top_grow(heap *heap, size_t size) {
+    page_header *page = heap->top;
+    if (page == NULL)
+        return NULL;
+    block_header *end = (void*)page + page->size - sizeof(block_header);
+    //a free region ending the page already makes up part of the space
+    block_header *last = header_isprevfree(end) ? header_prev(end) : end;
+    size_t have = (void*)end - (void*)last;
+    if (have >= size + sizeof(block_header))
+        return last;
+    size_t grow = (size + sizeof(block_header) - have + PAGE_GRANULE - 1) & ~(PAGE_GRANULE - 1);
+    if (reserve_commit(heap, grow) == NULL)
+        return NULL;
+    page->size += grow;
+    block_header *newEnd = (void*)page + page->size - sizeof(block_header);
+    newEnd->data = 0;
+    header_setend(newEnd, true);
+    header_setsize(newEnd, page->size - sizeof(block_header));
+    //the old page-end becomes a free region running up to the new one
+    bool prevfree = header_isprevfree(end);
+    end->data = 0;
+    header_setprevfree(end, prevfree);
+    header_setheap(end, heap);
+    header_setfree(end, true);
+    header_setsize(end, (void*)newEnd - REGION_FROM_HEADER(end));
+    bin_insert(end);
+    return prevfree ? coalesce(last) : end;
+}
+
+//shrink the heap's top page while too much is free at its end, header being the free region
+//ending it; the caller must hold the heap's lock
+void top_trim(heap *heap, block_header *header) {
+    size_t size = header_getsize(header);
+    if (size <= 2 * TOP_PAD)
+        return;
+    //the page keeps ending on a granule, as the reservation is committed in them
+    size_t excess = (size - TOP_PAD) & ~(PAGE_GRANULE - 1);
+    if (excess == 0)
+        return;
+    page_header *page = heap->top;
+    bin_remove(header);
+    header_setsize(header, size - excess);
+    page->size -= excess;
+    block_header *end = (void*)page + page->size - sizeof(block_header);
+    end->data = 0;
+    header_setend(end, true);
+    header_setsize(end, page->size - sizeof(block_header));
+    bin_insert(header);
+    reserve_decommit(heap, excess);
+}
+
+/*--- TRACING ---*/
+
+//start recording a trace into the file at path, mapping size bytes of it
+void trace_init(const char *path, size_t size) {
+    //a %p in the path stands for the process id, so that the programs a traced process
+    //runs, which inherit MYALLOC_TRACE, can each write a trace of their own
+    char name[PATH_MAX];
+    size_t length = 0;
+    for (const char *c = path; *c != '\0' && length < sizeof(name) - 24; c++) {
+        if (c[0] == '%' && c[1] == 'p') {
+            length += sprintf(name + length, "%d", (int)getpid());
+            c++;
+        } else {
+            name[length++] = *c;
+        }
+    }
+    name[length] = '\0';
+    //a trace of the same name is replaced rather than truncated, as a process may still
+    //have it mapped, and would fault writing past its end
+    unlink(name);
+    int fd = open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("myalloc trace error:");
+        return;
+    }
+    //the file stays sparse until events are written to it
+    void *file = MAP_FAILED;
+    if (size > sizeof(trace_header) && ftruncate(fd, size) == 0)
+        file = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED) {
+        perror("myalloc trace error:");
+        close(fd);
+        return;
+    }
+    TRACE_FILE = file;
+    memcpy(TRACE_FILE->magic, TRACE_MAGIC, sizeof(TRACE_FILE->magic));
+    TRACE_CAPACITY = (size - sizeof(trace_header)) / sizeof(trace_event);
+    TRACE_FD = fd;
+    TRACE_START = now_ns();
+    pthread_key_create(&TRACE_KEY, trace_destroy);
+    TRACING = true;
+}
+
+//record an event in the calling thread's trace buffer, flushing the buffer if full
+void trace_record(unsigned int kind, void *address, void *previous, size_t size) {
+    trace_buffer *buffer = TRACE_BUFFER;
+    if (buffer == NULL) {
+        //mapped rather than allocated, which would be traced in turn
+        buffer = mmap(NULL, sizeof(trace_buffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED)
+            return;
+        buffer->thread = __atomic_fetch_add(&TRACE_THREADS, 1, __ATOMIC_RELAXED);
+        //set first, as the thread library may allocate a slot for the key
+        TRACE_BUFFER = buffer;
+        pthread_setspecific(TRACE_KEY, buffer);
+    }
+    trace_event *event = &buffer->events[buffer->count++];
+    event->time = now_ns() - TRACE_START;
+    event->address = (uintptr_t)address;
+    event->previous = (uintptr_t)previous;
+    event->size = size;
+    event->thread = buffer->thread;
+    event->kind = kind;
+    if (buffer->count == TRACE_BUFFER_EVENTS)
+        trace_flush(buffer);
+}
+
+//copy a thread's buffered events into the trace file
+void trace_flush(trace_buffer *buffer) {
+    size_t first = __atomic_fetch_add(&TRACE_RESERVED, buffer->count, __ATOMIC_RELAXED);
+    if (first + buffer->count <= __atomic_load_n(&TRACE_CAPACITY, __ATOMIC_ACQUIRE)) {
+        trace_event *events = (trace_event*)(TRACE_FILE + 1);
+        memcpy(&events[first], buffer->events, buffer->count * sizeof(trace_event));
+        __atomic_fetch_add(&TRACE_FILE->events, buffer->count, __ATOMIC_RELEASE);
+    } else {
+        __atomic_fetch_add(&TRACE_FILE->dropped, buffer->count, __ATOMIC_RELAXED);
+    }
+    buffer->count = 0;
+}
+
+//flush and unmap a thread's trace buffer, used on thread exit
+void trace_destroy(void *buffer) {
+    trace_flush(buffer);
+    munmap(buffer, sizeof(trace_buffer));
+    //the thread may still free memory in later destructors
+    TRACE_BUFFER = NULL;
+}
+
+//finish the trace at exit, cutting the file down to the events written; the buffers of
+//threads still running are lost, and any they flush from now on is dropped
+__attribute__((destructor))
+static void trace_finish() {
+    if (!TRACING)
+        return;
+    if (TRACE_BUFFER != NULL)
+        trace_flush(TRACE_BUFFER);
+    TRACING = false;
+    size_t capacity = __atomic_exchange_n(&TRACE_CAPACITY, 0, __ATOMIC_ACQ_REL);
+    size_t reserved = __atomic_load_n(&TRACE_RESERVED, __ATOMIC_ACQUIRE);
+    size_t used = reserved < capacity ? reserved : capacity;
+    ftruncate(TRACE_FD, sizeof(trace_header) + used * sizeof(trace_event));
+}
+
+//print a visual representation of the memory starting from header, moving right
+void header_print(block_header *header) {
+    if (header != NULL) {
+        while (true) {
+            if (header_isend(header)) {
+                page_header *next = PAGE_FROM_END(header)->next;
+                if (next == NULL)
+                    break;
+                printf("|END|  >  ");
+                header = FIRST_HEADER_FROM_PAGE(next);
+                continue;
+            }
+            if (header_isstart(header) && PAGE_FROM_FIRST_HEADER(header) == header_getheap(header)->pages)
+                printf("|ROOT|");
+            else
+                printf("|HEAD|");
+
+            size_t size = header_getsize(header);
+            if (header_isfree(header))
+                printf("___%zu___", size);
+            else
+                printf("***%zu***", size);
+            header = header_next(header);
+        }
+        printf("|END|\n");
+    }
+}
+
+/*--- PROFILING ---*/
+
+//set up the heap profiler to sample every rate bytes on average, and to write a profile to
+//a file named after path on PROFILE_SIGNAL if path is not NULL
+void profile_init(size_t rate, const char *path) {
+    //mapped rather than allocated, the tables stay untouched until used
+    PROFILE_SITES = mmap(NULL, PROFILE_SITE_SLOTS * sizeof(profile_site), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    PROFILE_OBJECTS = mmap(NULL, PROFILE_OBJECT_SLOTS * sizeof(profile_object), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (PROFILE_SITES == MAP_FAILED || PROFILE_OBJECTS == MAP_FAILED)
+        return;
+    PROFILE_RATE = rate;
+    if (path != NULL) {
+        PROFILE_PATH = path;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = profile_signal;
+        action.sa_flags = SA_RESTART;
+        sigaction(PROFILE_SIGNAL, &action, NULL);
+    }
+    PROFILING = true;
+}
 
-//append a new region to the end of the memory, creates a new page if needed
-block_header *append_region(unsigned int size);
+//count an allocation of size bytes towards the calling thread's next sample, sampling it
+//if it is due
+void profile_allocate(void *region, size_t size) {
+    if (size < PROFILE_COUNTDOWN) {
+        PROFILE_COUNTDOWN -= size;
+        return;
+    }
+    profile_sample(region, size);
+}
 
-//divide a region into two, based on size, updating the necessary header pointers
-block_header *divide(block_header *header, unsigned int size);
-
-//coalesce this region and the region to its right
-//return NULL if header is NULL, non-free or is a page-end
-//if the region on the right is NULL, non-free or is a page end then nothing will change
-//return the header of the combined region
-block_header *coalesce(block_header *header);
-
-//perform coalesce on all applicable regions, right-ward
-block_header *coalesce_right(block_header *header);
-
-//deallocate regions that should be removed as fit; pass header as a hint.
-void clean(block_header *header);
+//record the call stack of an allocation due to be sampled, and draw the next interval
+__attribute__((noinline))
+void profile_sample(void *region, size_t size) {
+    //a thread's first allocation only starts its countdown
+    if (PROFILE_COUNTDOWN == 0) {
+        PROFILE_COUNTDOWN = profile_interval();
+        if (size < PROFILE_COUNTDOWN) {
+            PROFILE_COUNTDOWN -= size;
+            return;
+        }
+    }
+    PROFILE_COUNTDOWN = profile_interval();
+    if (PROFILE_BUSY)
+        return;
+    PROFILE_BUSY = true;
+    //the first frame is this function's own
+    void *stack[PROFILE_DEPTH + 1];
+    int depth = backtrace(stack, PROFILE_DEPTH + 1) - 1;
+    pthread_mutex_lock(&PROFILE_LOCK);
+    profile_site *site = depth > 0 ? profile_site_find(stack + 1, depth) : NULL;
+    //a region is only sampled while the table is at most three quarters full, which
+    //keeps its searches short
+    if (site != NULL && PROFILE_OBJECT_COUNT < PROFILE_OBJECT_SLOTS / 4 * 3) {
+        size_t slot = profile_slot(region);
+        while (PROFILE_OBJECTS[slot].region != NULL)
+            slot = (slot + 1) & (PROFILE_OBJECT_SLOTS - 1);
+        PROFILE_OBJECTS[slot].region = region;
+        PROFILE_OBJECTS[slot].site = site;
+        PROFILE_OBJECTS[slot].size = size;
+        PROFILE_OBJECT_COUNT++;
+        PROFILE_FILTER[profile_bucket(region)]++;
+        site->liveCount++;
+        site->liveBytes += size;
+        site->totalCount++;
+        site->totalBytes += size;
+    }
+    pthread_mutex_unlock(&PROFILE_LOCK);
+    if (PROFILE_REQUESTED) {
+        PROFILE_REQUESTED = 0;
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "%s.%d.%u.heap", PROFILE_PATH, (int)getpid(), __atomic_fetch_add(&PROFILE_DUMPS, 1, __ATOMIC_RELAXED));
+        myalloc_profile_dump(name);
+    }
+    PROFILE_BUSY = false;
+}
+
+//forget a region about to be freed, if it was sampled
+void profile_release(void *region) {
+    if (__atomic_load_n(&PROFILE_FILTER[profile_bucket(region)], __ATOMIC_RELAXED) == 0)
+        return;
+    pthread_mutex_lock(&PROFILE_LOCK);
+    size_t mask = PROFILE_OBJECT_SLOTS - 1;
+    size_t slot = profile_slot(region);
+    while (PROFILE_OBJECTS[slot].region != NULL && PROFILE_OBJECTS[slot].region != region)
+        slot = (slot + 1) & mask;
+    if (PROFILE_OBJECTS[slot].region != NULL) {
+        profile_site *site = PROFILE_OBJECTS[slot].site;
+        site->liveCount--;
+        site->liveBytes -= PROFILE_OBJECTS[slot].size;
+        PROFILE_OBJECT_COUNT--;
+        PROFILE_FILTER[profile_bucket(region)]--;
+        //close the gap, moving back each region after it that may not be found past it
+        size_t gap = slot;
+        for (size_t next = (slot + 1) & mask; PROFILE_OBJECTS[next].region != NULL; next = (next + 1) & mask) {
+            size_t home = profile_slot(PROFILE_OBJECTS[next].region);
+            if (((next - home) & mask) >= ((next - gap) & mask)) {
+                PROFILE_OBJECTS[gap] = PROFILE_OBJECTS[next];
+                gap = next;
+            }
+        }
+        PROFILE_OBJECTS[gap].region = NULL;
+    }
+    pthread_mutex_unlock(&PROFILE_LOCK);
+}
+
+//return the number of bytes to the calling thread's next sample, drawn at random
+size_t profile_interval() {
+    if (PROFILE_SEED == 0)
+        PROFILE_SEED = (now_ns() ^ (uintptr_t)&PROFILE_SEED) | 1;
+    //xorshift64
+    PROFILE_SEED ^= PROFILE_SEED << 13;
+    PROFILE_SEED ^= PROFILE_SEED >> 7;
+    PROFILE_SEED ^= PROFILE_SEED << 17;
+    //uniform in (0, 1], so the interval is exponentially distributed with mean PROFILE_RATE
+    double uniform = ((PROFILE_SEED >> 11) + 1) / 9007199254740992.0;
+    return (size_t)(-profile_log(uniform) * PROFILE_RATE) + 1;
+}
+
+//return the natural logarithm of x, for 0 < x <= 1
+double profile_log(double x) {
+    //x = m * 2^exponent with 1 <= m < 2, taken apart without the maths library
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & ~((uint64_t)0x7ff << 52)) | ((uint64_t)1023 << 52);
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    //ln m = 2 atanh t, and t is at most 1/3, so the series converges quickly
+    double t = (m - 1) / (m + 1);
+    double t2 = t * t;
+    return exponent * 0.6931471805599453 + 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 / 9))));
+}
+
+//return the site of the profiler's table with the given call stack, adding it if new, or
+//NULL if the table is full; the caller must hold PROFILE_LOCK
+profile_site *profile_site_find(void **stack, unsigned int depth) {
+    uint64_t hash = depth;
+    for (unsigned int i = 0; i < depth; i++)
+        hash = (hash ^ (uintptr_t)stack[i]) * 0x100000001b3;
+    for (unsigned int probe = 0; probe < PROFILE_SITE_SLOTS; probe++) {
+        profile_site *site = &PROFILE_SITES[(hash + probe) & (PROFILE_SITE_SLOTS - 1)];
+        if (site->depth == 0) {
+            memcpy(site->stack, stack, depth * sizeof(void*));
+            site->depth = depth;
+            return site;
+        }
+        if (site->depth == depth && memcmp(site->stack, stack, depth * sizeof(void*)) == 0)
+            return site;
+    }
+    return NULL;
+}
+
+//return the slot of the profiler's table of sampled regions a region is looked for from
+size_t profile_slot(void *region) {
+    return ((uintptr_t)region >> 4) * 0x9e3779b97f4a7c15 >> (64 - 16);
+}
+
+//return the counter of the sampled regions filter a region belongs to
+unsigned int profile_bucket(void *region) {
+    return ((uintptr_t)region >> 4) & ((1 << PROFILE_FILTER_BITS) - 1);
+}
 
-//print a visual representation of the memory starting from header, moving right
-void header_print(block_header *header);
-
-//return the corresponding region size from the header's data segment
-int header_getsize(block_header *header);
-
-//set the size value for the header to the value of size
-//warning, the msb of the size field is ignored!
-void header_setsize(block_header *header, int size);
-
-//return true if the region this header corresponds to is marked as free
-bool header_isfree(block_header *header);
-
-//set the header's free-flag to the value of free
-void header_setfree(block_header *header, bool free);
-
-//return true if the header's page-end-bit is set
-bool header_isend(block_header *header);
-
-//set the header's page-eng-flag to the value of end
-void header_setend(block_header *header, bool end);
-
-//we store an entry point to the memory (essentially the head to a linked list)
-static block_header *ROOT = NULL;
-
-//we will update END as blocks get added
-static block_header *END = NULL;
-
-/*------------------------------*/
-/*--- MYALLOC IMPLEMENTATION ---*/
-/*------------------------------*/
-void *myalloc(int size) {
-    if (ROOT == NULL)
-        init();
-    block_header *header = first_fit(size);
-    return REGION_FROM_HEADER(header);
-}
-
-void myfree(void *ptr) {
-    //mark the region as "not being used", but leave deallocation up to the coalescing function
-    block_header *header = HEADER_FROM_REGION(ptr);
-    header_setfree(header, true);
-    //todo coalesce
-    coalesce_right(header);
-    clean(header);
-}
-
-/*--- OTHER FUNCTIONS ---*/
-
-void init() {
-    ROOT = allocatePage(1);
-    END = ROOT->next;
-    END->next = NULL;
-}
-
 /*
- * Allocate n pages-worth of heap space, return a pointer to the beginning of the
- * page as a block header. The block header in question initially represents the
- * whole page as a free region.
- * A header is also placed at the end of the page, with page-end-bit set to 1, and a size of 0
- * this header will always be "in-use" internally; eventually the header's next pointer
- * will point to the base of the next page(s) that get allocated.
- * If n is 0, NULL is returned.
+ * A profile is written in the legacy heap profile format: a header with the totals and
+ * the sampling rate, a line per call site giving its live and total sampled regions and
+ * bytes, then the process's memory map, so addresses can be put down to their functions.
+ *
+ * heap profile: 12: 8192 [ 40: 30720] @ heap_v2/524288
+ * 2: 1024 [ 10: 5120] @ 0x4005d2 0x400631 0x7f3a1c829d90
+ *
+ * MAPPED_LIBRARIES:
+ * ...
  */
-block_header *allocatePage(unsigned int n) {
-    if (n == 0)
-        return NULL;
-    size_t size = n * getpagesize();
-    //printf("allocating new page of memory, size %lu\n", size);
-    void *alloc = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (alloc == MAP_FAILED)
-        perror("myalloc MMAP error:");
-    block_header *pageRoot = (block_header*) alloc;
-    block_header *pageFooter = (void *)pageRoot + (size - sizeof(block_header));
-    header_setend(pageFooter, true);
-    pageRoot->next = pageFooter;
-    pageRoot->data = 0;
-    header_setfree(pageRoot, true);
-    header_setsize(pageRoot, size - sizeof(block_header));
-    pageRoot->prev = NULL;
-    pageFooter->prev = pageRoot;
-    return pageRoot;
-}
-
-//return pointer to heap space in the first free region that can support a block
-//allocation of the specified size
-block_header *first_fit(unsigned int size) {
-    if (size < ALLOCATION_MINIMUM)
-        size = ALLOCATION_MINIMUM;
-    block_header *header = ROOT;
-    while (header == ROOT || header->next != NULL) {
-        int regionSize = header_getsize(header);
-        //We should make sure that there would be at least enough space to
-        //allocate a minimum unit in the block ahead of this one.
-        if (header_isfree(header) && regionSize >= size) {
-            if (regionSize >= size + sizeof(block_header)) {
-                //the region in question is big enough to be split into two
-                return divide(header, size);
+
+//write a heap profile to an open file, return false on failure
+bool profile_write(int fd) {
+    char line[64 + PROFILE_DEPTH * 20];
+    bool written = true;
+    pthread_mutex_lock(&PROFILE_LOCK);
+    unsigned long liveCount = 0, totalCount = 0;
+    size_t liveBytes = 0, totalBytes = 0;
+    for (size_t i = 0; i < PROFILE_SITE_SLOTS; i++) {
+        liveCount += PROFILE_SITES[i].liveCount;
+        liveBytes += PROFILE_SITES[i].liveBytes;
+        totalCount += PROFILE_SITES[i].totalCount;
+        totalBytes += PROFILE_SITES[i].totalBytes;
+    }
+    int length = snprintf(line, sizeof(line), "heap profile: %lu: %zu [ %lu: %zu] @ heap_v2/%zu\n", liveCount, liveBytes, totalCount, totalBytes, PROFILE_RATE);
+    written = write(fd, line, length) == length;
+    for (size_t i = 0; written && i < PROFILE_SITE_SLOTS; i++) {
+        profile_site *site = &PROFILE_SITES[i];
+        if (site->depth == 0)
+            continue;
+        length = snprintf(line, sizeof(line), "%lu: %zu [ %lu: %zu] @", site->liveCount, site->liveBytes, site->totalCount, site->totalBytes);
+        for (unsigned int frame = 0; frame < site->depth; frame++)
+            length += snprintf(line + length, sizeof(line) - length, " %#lx", (unsigned long)(uintptr_t)site->stack[frame]);
+        line[length++] = '\n';
+        written = write(fd, line, length) == length;
+    }
+    pthread_mutex_unlock(&PROFILE_LOCK);
+    const char *maps = "\nMAPPED_LIBRARIES:\n";
+    written = written && write(fd, maps, strlen(maps)) == (ssize_t)strlen(maps);
+    int mapsFd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (mapsFd < 0)
+        return false;
+    ssize_t read_;
+    while (written && (read_ = read(mapsFd, line, sizeof(line))) > 0)
+        written = write(fd, line, read_) == read_;
+    close(mapsFd);
+    return written;
+}
+
+//record that a profile was asked for by signal, to be written at the next sample
+void profile_signal(int signal) {
+    PROFILE_REQUESTED = 1;
+}
+
+/*--- HEAP DUMPS ---*/
+
+//add a record of the heap and its pages to a heap dump, counts being where the bytes in
+//use of each cell are added up, return false if out of memory; the caller must hold the
+//heap's lock
+bool dump_heap(dump_buffer *buffer, dump_buffer *counts, heap *heap) {
+    size_t cell = getpagesize();
+    //the buffer may move as pages are added, so the heap's record is found by its offset
+    size_t offset = buffer->length;
+    heapdump_heap *record = dump_reserve(buffer, sizeof(heapdump_heap));
+    if (record == NULL)
+        return false;
+    record->index = heap->index;
+    record->node = heap->node;
+    record->mapped = heap->mapped;
+    record->in_use = heap->inUse;
+    record->retained = heap->retainedBytes;
+    for (int class = 0; class < SIZE_CLASS_COUNT; class++)
+        record->free += heap->freeBytes[class];
+    uint64_t freeCount[SIZE_CLASS_COUNT] = {0};
+    uint64_t freeBytes[SIZE_CLASS_COUNT] = {0};
+    uint64_t pages = 0;
+    for (page_header *page = heap->pages; page != NULL; page = page->next) {
+        counts->length = 0;
+        int32_t *used = dump_reserve(counts, page->size / cell * sizeof(int32_t));
+        if (used == NULL)
+            return false;
+        heapdump_page summary = {0};
+        block_header *header = FIRST_HEADER_FROM_PAGE(page);
+        //the page header, and the header ending the page, count as in use
+        dump_count(used, page, page, header, 1);
+        for (; !header_isend(header); header = header_next(header)) {
+            size_t size = header_getsize(header);
+            if (header_isfree(header)) {
+                summary.free += size;
+                summary.free_regions++;
+                if (size > summary.largest_free)
+                    summary.largest_free = size;
+                freeCount[size_class(size)]++;
+                freeBytes[size_class(size)] += size;
             } else {
-                //the region is not big enough to be split, but is still big
-                //enough to hold the requested size
-                //return the header, with no alterations to size
-                header_setfree(header, false);
-                return header;
+                summary.in_use += size;
+                summary.regions++;
+                dump_count(used, page, header, REGION_FROM_HEADER(header) + size, 1);
             }
         }
-        header = header->next;
-    }
-    //if we reach here, no fit could be found, allocate new space
-    return append_region(size);
-}
-
-//append a new region after the last region (hence, in a new page)
-block_header *append_region(unsigned int size) {
-    block_header *oldEnd = END;
-    block_header *page = allocatePage((size / getpagesize()) + 1);
-    page->prev = oldEnd;
-    //point end to the cap of the new page
-    END = page->next;
-    END->prev = page;
-    //the cap of the old page contains a pointer to the header of the new page
-    oldEnd->next = page;
-    assert(divide(page, size) != NULL);
+        dump_count(used, page, header, (void*)page + page->size, 1);
+        heapdump_page *added = dump_page(buffer, used, page, page->size, HEAPDUMP_REGIONS);
+        if (added == NULL)
+            return false;
+        summary.address = added->address;
+        summary.size = added->size;
+        summary.kind = added->kind;
+        summary.cells = added->cells;
+        *added = summary;
+        pages++;
+    }
+    for (slab *slab = heap->allSlabs; slab != NULL; slab = slab->allNext) {
+        counts->length = 0;
+        int32_t *used = dump_reserve(counts, slab->span / cell * sizeof(int32_t));
+        if (used == NULL)
+            return false;
+        //every slot carved so far is taken to be in use, then the freed ones are not
+        dump_count(used, slab, slab, slab->unused, 1);
+        for (void *slot = slab->free; slot != NULL; slot = *(void**)slot)
+            dump_count(used, slab, slot, slot + slab->size, -1);
+        heapdump_page *added = dump_page(buffer, used, slab, slab->span, HEAPDUMP_SLAB);
+        if (added == NULL)
+            return false;
+        added->in_use = (uint64_t)slab->used * slab->size;
+        added->free = (uint64_t)(slab->capacity - slab->used) * slab->size;
+        added->regions = slab->used;
+        added->free_regions = slab->capacity - slab->used;
+        added->largest_free = slab->used < slab->capacity ? slab->size : 0;
+        pages++;
+    }
+    //an arena's chunks are in use as a whole as far as the heap is concerned, its objects
+    //are not tracked, and its pointer moves without the heap's lock
+    for (myarena *arena = heap->arenas; arena != NULL; arena = arena->arenaNext) {
+        for (page_header *chunk = (page_header*)arena - 1; chunk != NULL; chunk = chunk->next) {
+            counts->length = 0;
+            int32_t *used = dump_reserve(counts, chunk->size / cell * sizeof(int32_t));
+            if (used == NULL)
+                return false;
+            dump_count(used, chunk, chunk, (void*)chunk + chunk->size, 1);
+            heapdump_page *added = dump_page(buffer, used, chunk, chunk->size, HEAPDUMP_ARENA);
+            if (added == NULL)
+                return false;
+            added->in_use = chunk->size;
+            added->regions = 1;
+            pages++;
+        }
+    }
+    for (int i = 0; i < heap->retainedCount; i++) {
+        retained_page *page = &heap->retained[i];
+        counts->length = 0;
+        int32_t *used = dump_reserve(counts, page->size / cell * sizeof(int32_t));
+        if (used == NULL)
+            return false;
+        heapdump_page *added = dump_page(buffer, used, page->base, page->size, HEAPDUMP_RETAINED);
+        if (added == NULL)
+            return false;
+        added->free = page->size;
+        added->largest_free = page->size;
+        pages++;
+    }
+    record = buffer->data + offset;
+    record->pages = pages;
+    memcpy(record->free_count, freeCount, sizeof(freeCount));
+    memcpy(record->free_bytes, freeBytes, sizeof(freeBytes));
+    return true;
+}
+
+//add a record of the page of size bytes at base to a heap dump, counts giving the bytes in
+//use of each of its cells; return the record, or NULL if out of memory
+heapdump_page *dump_page(dump_buffer *buffer, int32_t *counts, void *base, size_t size, uint32_t kind) {
+    size_t cell = getpagesize();
+    size_t cells = size / cell;
+    heapdump_page *page = dump_reserve(buffer, sizeof(heapdump_page) + ((cells + 7) & ~(size_t)7));
+    if (page == NULL)
+        return NULL;
+    page->address = (uintptr_t)base;
+    page->size = size;
+    page->kind = kind;
+    page->cells = cells;
+    unsigned char *map = (unsigned char*)(page + 1);
+    for (size_t i = 0; i < cells; i++)
+        map[i] = (counts[i] * 100 + cell - 1) / cell;
     return page;
-}
+}
 
-//divide a region into two, based on size, updating the necessary header pointers
-//return a the passed header, or NULL if the region could not be divided
-block_header *divide(block_header *header, unsigned int size) {
-    //if the passed header was null, was not free (therefore including page-ends),
-    //or doesn't have sufficient size; return null
-    if (header == NULL || !header_isfree(header) || header_getsize(header) < size - sizeof(block_header))
+//mark the cells of a heap dump's pages whose memory is not resident, once the heaps are
+//unlocked, using scratch for the system's answers; return false if out of memory
+bool dump_residency(dump_buffer *buffer, dump_buffer *scratch) {
+    size_t offset = sizeof(heapdump_header);
+    for (uint32_t i = 0; i < ((heapdump_header*)buffer->data)->heaps; i++) {
+        uint64_t pages = ((heapdump_heap*)(buffer->data + offset))->pages;
+        offset += sizeof(heapdump_heap);
+        for (uint64_t j = 0; j < pages; j++) {
+            heapdump_page *page = buffer->data + offset;
+            unsigned char *map = (unsigned char*)(page + 1);
+            offset += sizeof(heapdump_page) + (((size_t)page->cells + 7) & ~(size_t)7);
+            scratch->length = 0;
+            unsigned char *resident = dump_reserve(scratch, page->cells);
+            if (resident == NULL)
+                return false;
+            //a page given up since it was walked cannot be told, and is taken to be
+            //resident, as is one the system will not tell about
+            if (mincore((void*)(uintptr_t)page->address, page->size, resident) != 0)
+                continue;
+            for (uint32_t k = 0; k < page->cells; k++) {
+                if (!(resident[k] & 1))
+                    map[k] = HEAPDUMP_NOT_RESIDENT;
+            }
+        }
+    }
+    return true;
+}
+
+//add sign times the bytes from start to end, within the page at base, to the counts of
+//the cells they cover
+void dump_count(int32_t *counts, void *base, void *start, void *end, int sign) {
+    size_t cell = getpagesize();
+    while (start < end) {
+        size_t index = (start - base) / cell;
+        void *cellEnd = base + (index + 1) * cell;
+        void *stop = end < cellEnd ? end : cellEnd;
+        counts[index] += sign * (stop - start);
+        start = stop;
+    }
+}
+
+//return size more zeroed bytes at the end of a heap dump, or NULL if out of memory; the
+//buffer may move
+void *dump_reserve(dump_buffer *buffer, size_t size) {
+    if (buffer->length + size > buffer->capacity) {
+        size_t capacity = buffer->capacity == 0 ? (size_t)1 << 20 : buffer->capacity;
+        while (capacity < buffer->length + size)
+            capacity *= 2;
+        void *data = buffer->data == NULL
+            ? mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+            : mremap(buffer->data, buffer->capacity, capacity, MREMAP_MAYMOVE);
+        if (data == MAP_FAILED)
+            return NULL;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    void *reserved = buffer->data + buffer->length;
+    memset(reserved, 0, size);
+    buffer->length += size;
+    return reserved;
+}
+
+/*--- THREAD CACHE ---*/
+
+//take a region of at least size bytes from the calling thread's cache, or NULL if empty
+void *tcache_get(unsigned int size) {
+    int index = TCACHE_INDEX(size);
+    void *region = CACHE.bins[index];
+    if (region != NULL) {
+        CACHE.bins[index] = *(void**)region;
+        CACHE.counts[index]--;
+    }
+    return region;
+}
+
+static void tcache_key_create() {
+    pthread_key_create(&CACHE_KEY, tcache_destroy);
+}
+
+//have the calling thread's cache flushed when the thread exits
+void tcache_register() {
+    if (!CACHE.registered) {
+        //the key's destructor only runs for threads that set a value for it
+        pthread_once(&CACHE_KEY_ONCE, tcache_key_create);
+        pthread_setspecific(CACHE_KEY, &CACHE);
+        CACHE.registered = true;
+    }
+}
+
+//put an in-use region of size bytes into the calling thread's cache, flushing the
+//class if full
+void tcache_put(void *region, unsigned int size) {
+    tcache_register();
+    //a region may be larger than the class it was allocated for, file it under the
+    //largest class it can fully serve
+    int index = TCACHE_INDEX(size);
+    *(void**)region = CACHE.bins[index];
+    CACHE.bins[index] = region;
+    if (++CACHE.counts[index] >= TCACHE_CAPACITY)
+        tcache_flush(&CACHE, index, TCACHE_CAPACITY / 2);
+}
+
+//allocate a region of exactly size bytes from the heap, filling the calling
+//thread's cache for that class with more of them on the way
+void *tcache_refill(unsigned int size) {
+    //the extra regions would be lost with the thread if it never freed into the cache
+    tcache_register();
+    int index = TCACHE_INDEX(size);
+    heap *heap = thread_heap();
+    pthread_mutex_lock(&heap->lock);
+    void *region = allocate_small(heap, size);
+    for (int i = 1; region != NULL && i < TCACHE_CAPACITY / 2; i++) {
+        void *extra = allocate_small(heap, size);
+        if (extra == NULL)
+            break;
+        *(void**)extra = CACHE.bins[index];
+        CACHE.bins[index] = extra;
+        CACHE.counts[index]++;
+    }
+    pthread_mutex_unlock(&heap->lock);
+    return region;
+}
+
+//return regions from one class of a thread cache to the heap, until keep remain
+void tcache_flush(tcache *cache, int index, unsigned int keep) {
+    //regions freed by this thread may belong to any heap; those of other heaps are handed
+    //back to them, so only this thread's own heap is ever locked
+    heap *local = THREAD_HEAP;
+    bool locked = false;
+    while (cache->counts[index] > keep) {
+        void *region = cache->bins[index];
+        cache->bins[index] = *(void**)region;
+        cache->counts[index]--;
+        slab *slab = pagemap_get(region);
+        heap *owner = slab != NULL ? slab->heap : header_getheap(HEADER_FROM_REGION(region));
+        if (owner != local) {
+            remote_push(owner, region, region);
+            continue;
+        }
+        if (!locked) {
+            pthread_mutex_lock(&local->lock);
+            locked = true;
+        }
+        if (slab != NULL)
+            slab_free(slab, region);
+        else
+            release(HEADER_FROM_REGION(region));
+    }
+    if (locked)
+        pthread_mutex_unlock(&local->lock);
+}
+
+//return every region held by a thread's cache to the heap, used on thread exit
+void tcache_destroy(void *cache) {
+    //quarantined regions are released into the cache, so they go first
+    while (((tcache*)cache)->quarantineCount > 0)
+        quarantine_evict(cache, QUARANTINE_LIMIT);
+    for (int i = 0; i < TCACHE_BINS; i++) {
+        if (((tcache*)cache)->counts[i] > 0)
+            tcache_flush(cache, i, 0);
+    }
+}
+
+/*--- REMOTE FREES ---*/
+
+//hand a chain of regions of another thread's heap, linked through their first words from
+//first to last, back to that heap without waiting for its lock
+void remote_push(heap *heap, void *first, void *last) {
+    //regions are only ever taken off all at once, so the head cannot be popped and pushed
+    //again between the load and the swap
+    void *head = __atomic_load_n(&heap->remote, __ATOMIC_RELAXED);
+    do {
+        *(void**)last = head;
+    } while (!__atomic_compare_exchange_n(&heap->remote, &head, first, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//release the regions other threads have handed back to the heap; the caller must hold
+//the heap's lock
+void remote_drain(heap *heap) {
+    if (__atomic_load_n(&heap->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    void *region = __atomic_exchange_n(&heap->remote, NULL, __ATOMIC_ACQUIRE);
+    while (region != NULL) {
+        void *next = *(void**)region;
+        slab *slab = pagemap_get(region);
+        if (slab != NULL)
+            slab_free(slab, region);
+        else
+            release(HEADER_FROM_REGION(region));
+        region = next;
+    }
+}
+
+/*--- SLABS ---*/
+
+//hand out a free slot of size bytes from one of the heap's slabs, creating a slab if
+//there is none with room; the caller must hold the heap's lock
+void *slab_allocate(heap *heap, unsigned int size) {
+    remote_drain(heap);
+    slab *slab = heap->slabs[SLAB_INDEX(size)];
+    if (slab == NULL) {
+        slab = slab_create(heap, size);
+        if (slab == NULL)
+            return NULL;
+    }
+    void *slot;
+    if (slab->free != NULL) {
+        slot = slab->free;
+        slab->free = *(void**)slot;
+    } else {
+        slot = slab->unused;
+        slab->unused += size;
+    }
+    if (++slab->used == slab->capacity) {
+        //a full slab has nothing left to offer, take it off the heap's list
+        heap->slabs[SLAB_INDEX(size)] = slab->next;
+        if (slab->next != NULL)
+            slab->next->prev = NULL;
+        slab->next = NULL;
+    }
+    heap->inUse += size;
+    return slot;
+}
+
+//create an empty slab of size byte slots for the heap, from a newly acquired page
+slab *slab_create(heap *heap, unsigned int size) {
+    page_header *page = page_acquire(heap, 1);
+    if (page == NULL)
         return NULL;
-    block_header *middle = REGION_FROM_HEADER(header) + size;
-    block_header *next = header->next;
-    header_setsize(header, ((void*)middle) - ((void*)REGION_FROM_HEADER(header)));
-    header_setsize(middle, ((void*)next) - ((void*)REGION_FROM_HEADER(middle)));
-    header_setfree(header, false);
-    header_setfree(middle, true);
-    header->next = middle;
-    middle->next = next;
-    middle->prev = header;
-    next->prev = middle;
+    size_t span = page->size;
+    slab *slab = (struct slab*)page;
+    slab->span = span;
+    slab->heap = heap;
+    slab->free = NULL;
+    slab->unused = (void*)slab + SLAB_SLOTS_OFFSET;
+    slab->size = size;
+    slab->used = 0;
+    slab->capacity = (span - SLAB_SLOTS_OFFSET) / size;
+    slab->prev = NULL;
+    slab->next = heap->slabs[SLAB_INDEX(size)];
+    if (slab->next != NULL)
+        slab->next->prev = slab;
+    heap->slabs[SLAB_INDEX(size)] = slab;
+    slab->allPrev = NULL;
+    slab->allNext = heap->allSlabs;
+    if (slab->allNext != NULL)
+        slab->allNext->allPrev = slab;
+    heap->allSlabs = slab;
+    pagemap_set(slab, span, slab);
+    return slab;
+}
+
+//return a slot to its slab, releasing the slab's page if it becomes empty and is not
+//the only slab of its class with room; the caller must hold the slab's heap's lock
+void slab_free(slab *slab, void *slot) {
+    struct slab **list = &slab->heap->slabs[SLAB_INDEX(slab->size)];
+    slab->heap->inUse -= slab->size;
+    *(void**)slot = slab->free;
+    slab->free = slot;
+    if (slab->used-- == slab->capacity) {
+        //the slab was full, so it has to be put back on the heap's list
+        slab->prev = NULL;
+        slab->next = *list;
+        if (*list != NULL)
+            (*list)->prev = slab;
+        *list = slab;
+    }
+    if (slab->used == 0 && (*list != slab || slab->next != NULL)) {
+        if (slab->prev != NULL)
+            slab->prev->next = slab->next;
+        else
+            *list = slab->next;
+        if (slab->next != NULL)
+            slab->next->prev = slab->prev;
+        if (slab->allPrev != NULL)
+            slab->allPrev->allNext = slab->allNext;
+        else
+            slab->heap->allSlabs = slab->allNext;
+        if (slab->allNext != NULL)
+            slab->allNext->allPrev = slab->allPrev;
+        //forget the slab before its page can be handed out again
+        pagemap_set(slab, slab->span, NULL);
+        page_retain(slab->heap, slab, slab->span);
+    }
+}
+
+/*--- PAGE MAP ---*/
+
+//return the slab holding the given address, or NULL if it is not within a slab
+slab *pagemap_get(void *address) {
+    uintptr_t page = (uintptr_t)address >> PAGEMAP_SHIFT;
+    uintptr_t root = (page >> PAGEMAP_LEAF_BITS) & ((1 << PAGEMAP_ROOT_BITS) - 1);
+    slab **leaf = __atomic_load_n(&PAGEMAP[root], __ATOMIC_ACQUIRE);
+    return leaf == NULL ? NULL : leaf[page & ((1 << PAGEMAP_LEAF_BITS) - 1)];
+}
+
+//record value as the slab holding each page of the given range
+void pagemap_set(void *address, size_t length, slab *value) {
+    uintptr_t first = (uintptr_t)address >> PAGEMAP_SHIFT;
+    uintptr_t last = ((uintptr_t)address + length - 1) >> PAGEMAP_SHIFT;
+    for (uintptr_t page = first; page <= last; page++) {
+        uintptr_t root = (page >> PAGEMAP_LEAF_BITS) & ((1 << PAGEMAP_ROOT_BITS) - 1);
+        slab **leaf = __atomic_load_n(&PAGEMAP[root], __ATOMIC_ACQUIRE);
+        if (leaf == NULL) {
+            //leaves are only ever installed, two heaps racing to do so keep the first
+            leaf = mmap(NULL, sizeof(slab*) << PAGEMAP_LEAF_BITS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            assert(leaf != MAP_FAILED);
+            slab **expected = NULL;
+            if (!__atomic_compare_exchange_n(&PAGEMAP[root], &expected, leaf, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                munmap(leaf, sizeof(slab*) << PAGEMAP_LEAF_BITS);
+                leaf = expected;
+            }
+        }
+        leaf[page & ((1 << PAGEMAP_LEAF_BITS) - 1)] = value;
+    }
+}
+
+/*--- ARENAS ---*/
+
+myarena *myarena_create() {
+    heap *heap = thread_heap();
+    pthread_mutex_lock(&heap->lock);
+    page_header *page = arena_chunk(heap, ARENA_CHUNK);
+    myarena *arena = page == NULL ? NULL : (myarena*)(page + 1);
+    if (arena != NULL) {
+        //the heap's lock keeps the chain of chunks steady for heap dumps
+        page->next = NULL;
+        arena->heap = heap;
+        arena->arenaPrev = NULL;
+        arena->arenaNext = heap->arenas;
+        if (arena->arenaNext != NULL)
+            arena->arenaNext->arenaPrev = arena;
+        heap->arenas = arena;
+    }
+    pthread_mutex_unlock(&heap->lock);
+    if (arena != NULL)
+        myarena_reset(arena);
+    return arena;
+}
+
+void *myarena_alloc(myarena *arena, size_t size) {
+    if (size > ALLOCATION_MAXIMUM)
+        return NULL;
+    //every object gets an address of its own, and keeps the next one aligned
+    size = size == 0 ? ALLOCATION_ALIGNMENT : (size + ALLOCATION_ALIGNMENT - 1) & ~(ALLOCATION_ALIGNMENT - 1);
+    if (size > (size_t)(arena->end - arena->next) && !arena_advance(arena, size))
+        return NULL;
+    void *region = arena->next;
+    arena->next += size;
+    return region;
+}
+
+void myarena_reset(myarena *arena) {
+    page_header *first = (page_header*)arena - 1;
+    arena->chunk = first;
+    arena->next = ARENA_FIRST(arena + 1);
+    arena->end = (void*)first + first->size;
+}
+
+void myarena_destroy(myarena *arena) {
+    if (arena == NULL)
+        return;
+    heap *heap = arena->heap;
+    page_header *page = (page_header*)arena - 1;
+    pthread_mutex_lock(&heap->lock);
+    if (arena->arenaPrev != NULL)
+        arena->arenaPrev->arenaNext = arena->arenaNext;
+    else
+        heap->arenas = arena->arenaNext;
+    if (arena->arenaNext != NULL)
+        arena->arenaNext->arenaPrev = arena->arenaPrev;
+    while (page != NULL) {
+        page_header *next = page->next;
+        heap->inUse -= page->size;
+        page_retain(heap, page, page->size);
+        page = next;
+    }
+    pthread_mutex_unlock(&heap->lock);
+}
+
+//take a chunk of pages with room for size bytes from the heap for an arena, counting it
+//as in use, or NULL if out of memory; the caller must hold the heap's lock
+page_header *arena_chunk(heap *heap, size_t size) {
+    size_t pages = (size + getpagesize() - 1) / getpagesize();
+    if (pages > UINT_MAX)
+        return NULL;
+    page_header *page = page_acquire(heap, pages);
+    if (page != NULL)
+        heap->inUse += page->size;
+    return page;
+}
+
+//move an arena on to a chunk with room for size more bytes, the one after its current
+//chunk if that was kept through a reset and is large enough; return false if out of memory
+bool arena_advance(myarena *arena, size_t size) {
+    page_header *page = arena->chunk->next;
+    if (page == NULL || size > (size_t)((void*)page + page->size - ARENA_FIRST(page))) {
+        //room for the page header and the alignment of the first object too
+        size_t needed = size + 2 * ALLOCATION_ALIGNMENT + sizeof(page_header);
+        pthread_mutex_lock(&arena->heap->lock);
+        page = arena_chunk(arena->heap, needed < ARENA_CHUNK ? ARENA_CHUNK : needed);
+        //kept chunks too small for this come after it, for the next reset
+        if (page != NULL) {
+            page->next = arena->chunk->next;
+            arena->chunk->next = page;
+        }
+        pthread_mutex_unlock(&arena->heap->lock);
+        if (page == NULL)
+            return false;
+    }
+    arena->chunk = page;
+    arena->next = ARENA_FIRST(page);
+    arena->end = (void*)page + page->size;
+    return true;
+}
+
+/*--- DIRECT MAPPINGS ---*/
+
+//give a region of at least size bytes a mapping of its own, return NULL on failure
+block_header *map_region(size_t size) {
+    //the header goes in the second word, so that the region is aligned
+    size_t length = (size + ALLOCATION_ALIGNMENT + getpagesize() - 1) & ~((size_t)getpagesize() - 1);
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    numa_bind(base, length, thread_heap()->node);
+    __atomic_fetch_add(&MMAP_COUNT, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&DIRECT_BYTES, length, __ATOMIC_RELAXED);
+    block_header *header = HEADER_FROM_REGION(base + ALLOCATION_ALIGNMENT);
+    header->data = 0;
+    header_setmapped(header, true);
+    //the rounding up to whole pages is usable too
+    header_setsize(header, length - ALLOCATION_ALIGNMENT);
     return header;
 }
 
-//coalesce this region and the region to its right
-//return NULL if header is NULL, non-free or is a page-end
-//if the region on the right is NULL, non-free or is a page end then nothing will change
-//return the header of the combined region
-block_header *coalesce(block_header *header) {
-    if (header == NULL || !header_isfree(header) || header_isend(header))
+//give a region of at least size bytes, whose address is a multiple of alignment, a
+//mapping of its own; return NULL on failure
+block_header *map_aligned_region(size_t alignment, size_t size) {
+    size_t page = getpagesize();
+    size_t length = (size + sizeof(block_header) + alignment + page - 1) & ~(page - 1);
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
         return NULL;
-    else if (header->next == NULL || !header_isfree(header->next) || header_isend(header->next))
+    __atomic_fetch_add(&MMAP_COUNT, 1, __ATOMIC_RELAXED);
+    uintptr_t region = ((uintptr_t)base + sizeof(block_header) + alignment - 1) & ~((uintptr_t)alignment - 1);
+    //give back the whole pages before the header's page and after the region
+    uintptr_t start = (region - sizeof(block_header)) & ~((uintptr_t)page - 1);
+    uintptr_t end = (region + size + page - 1) & ~((uintptr_t)page - 1);
+    if (start > (uintptr_t)base)
+        munmap(base, start - (uintptr_t)base);
+    if (end < (uintptr_t)base + length)
+        munmap((void*)end, (uintptr_t)base + length - end);
+    numa_bind((void*)start, end - start, thread_heap()->node);
+    __atomic_fetch_add(&DIRECT_BYTES, end - start, __ATOMIC_RELAXED);
+    block_header *header = HEADER_FROM_REGION(region);
+    header->data = 0;
+    header_setmapped(header, true);
+    header_setsize(header, end - region);
+    return header;
+}
+
+/*
+ * A mapped region's header always lies within the first page of its mapping, though
+ * not necessarily at its start when the region was aligned, and the region always
+ * runs to the end of the mapping; so the mapping can be recovered from the header.
+ */
+
+//resize a region with a mapping of its own to at least size bytes, moving it if the
+//mapping cannot grow in place, unless tracing, which has to record the move before the
+//old mapping is released; return NULL on failure, leaving the region untouched
+block_header *remap_region(block_header *header, size_t size) {
+    size_t page = getpagesize();
+    void *base = (void*)((uintptr_t)header & ~((uintptr_t)page - 1));
+    size_t offset = REGION_FROM_HEADER(header) - base;
+    size_t length = offset + header_getsize(header);
+    size_t newLength = (offset + size + page - 1) & ~(page - 1);
+    if (newLength == length)
         return header;
-    //safe to combine
-    //printf("coalescing regions %p and %p\n", (void*)header, (void*)header->next);
-    block_header *right = header->next;
-    header_setsize(header, header_getsize(header) + sizeof(block_header) + header_getsize(right));
-    header->next = right->next;
+    void *remapped = mremap(base, length, newLength, TRACING ? 0 : MREMAP_MAYMOVE);
+    if (remapped == MAP_FAILED)
+        return NULL;
+    __atomic_fetch_add(&DIRECT_BYTES, newLength - length, __ATOMIC_RELAXED);
+    header = HEADER_FROM_REGION(remapped + offset);
+    header_setsize(header, newLength - offset);
     return header;
 }
 
-//perform coalesce on all applicable regions, right-ward
-block_header *coalesce_right(block_header *header) {
-    if (header == NULL)
+//return the mapping of a region with a mapping of its own to the system
+void unmap_region(block_header *header) {
+    void *base = (void*)((uintptr_t)header & ~((uintptr_t)getpagesize() - 1));
+    size_t length = REGION_FROM_HEADER(header) + header_getsize(header) - base;
+    munmap(base, length);
+    __atomic_fetch_add(&MUNMAP_COUNT, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&DIRECT_BYTES, length, __ATOMIC_RELAXED);
+}
+
+//return the number of bytes a region can hold, wherever it was allocated from
+size_t region_capacity(void *region) {
+    slab *slab = pagemap_get(region);
+    return slab != NULL ? slab->size : header_getsize(HEADER_FROM_REGION(region));
+}
+
+/*--- SIZE CLASSES ---*/
+
+//return the size class that a region of the given size belongs to
+int size_class(size_t size) {
+    //the index of the most significant set bit, i.e. floor(log2(size))
+    return sizeof(unsigned long) * CHAR_BIT - 1 - __builtin_clzl(size);
+}
+
+//add a free region to its heap's free structure
+void bin_insert(block_header *header) {
+    heap *heap = header_getheap(header);
+    if (POLICY == MYALLOC_SEGREGATED_FIT)
+        class_insert(heap, header);
+    else if (POLICY == MYALLOC_BEST_FIT)
+        tree_insert(heap, header);
+    else
+        list_insert(heap, header);
+    heap->freeBytes[size_class(header_getsize(header))] += header_getsize(header);
+    //the footer lets the region to the right find this one when it is freed
+    *FOOTER_FROM_HEADER(header) = header_getsize(header);
+    header_setprevfree(header_next(header), true);
+}
+
+//remove a free region from its heap's free structure
+void bin_remove(block_header *header) {
+    heap *heap = header_getheap(header);
+    if (POLICY == MYALLOC_SEGREGATED_FIT)
+        class_remove(heap, header);
+    else if (POLICY == MYALLOC_BEST_FIT)
+        tree_remove(heap, header);
+    else
+        list_remove(heap, header);
+    heap->freeBytes[size_class(header_getsize(header))] -= header_getsize(header);
+    header_setprevfree(header_next(header), false);
+}
+
+//return a free region of the heap with at least size bytes, chosen by the placement
+//policy, or NULL if there is none
+block_header *bin_find(heap *heap, size_t size) {
+    heap->allocations++;
+    if (POLICY == MYALLOC_SEGREGATED_FIT)
+        return class_find(heap, size);
+    if (POLICY == MYALLOC_BEST_FIT)
+        return tree_find(heap, size);
+    return list_find(heap, size);
+}
+
+//return the size of the largest free region of the heap; the caller must hold its lock
+size_t largest_free(heap *heap) {
+    size_t largest = 0;
+    if (POLICY == MYALLOC_BEST_FIT) {
+        //the last in the tree's order
+        block_header *header = heap->tree;
+        while (header != NULL && LINKS_FROM_HEADER(header)->next != NULL)
+            header = LINKS_FROM_HEADER(header)->next;
+        return header == NULL ? 0 : header_getsize(header);
+    }
+    //only the highest non-empty class can hold it, but any region in it may be largest;
+    //the address ordered list has to be walked in full
+    block_header *header = heap->list;
+    if (POLICY == MYALLOC_SEGREGATED_FIT)
+        header = heap->binmap == 0 ? NULL : heap->bins[SIZE_CLASS_COUNT - 1 - __builtin_clzl(heap->binmap)];
+    for (; header != NULL; header = LINKS_FROM_HEADER(header)->next) {
+        if (header_getsize(header) > largest)
+            largest = header_getsize(header);
+    }
+    return largest;
+}
+
+/*--- PLACEMENT POLICIES ---*/
+
+//add a free region to the free list of its size class, for segregated fit
+void class_insert(heap *heap, block_header *header) {
+    int class = size_class(header_getsize(header));
+    free_links *links = LINKS_FROM_HEADER(header);
+    links->prev = NULL;
+    links->next = heap->bins[class];
+    if (heap->bins[class] != NULL)
+        LINKS_FROM_HEADER(heap->bins[class])->prev = header;
+    heap->bins[class] = header;
+    heap->binmap |= (HEADER_DATA)1 << class;
+}
+
+//remove a free region from the free list of its size class
+void class_remove(heap *heap, block_header *header) {
+    int class = size_class(header_getsize(header));
+    free_links *links = LINKS_FROM_HEADER(header);
+    if (links->prev != NULL)
+        LINKS_FROM_HEADER(links->prev)->next = links->next;
+    else
+        heap->bins[class] = links->next;
+    if (links->next != NULL)
+        LINKS_FROM_HEADER(links->next)->prev = links->prev;
+    if (heap->bins[class] == NULL)
+        heap->binmap &= ~((HEADER_DATA)1 << class);
+}
+
+//return a free region with at least size bytes from the size class free lists
+block_header *class_find(heap *heap, size_t size) {
+    int class = size_class(size);
+    //regions in the requested class may still be too small, so only its head is
+    //tried, anything in a larger class is guaranteed to fit
+    if (heap->bins[class] != NULL) {
+        heap->scanned++;
+        if (header_getsize(heap->bins[class]) >= size)
+            return heap->bins[class];
+    }
+    HEADER_DATA larger = heap->binmap & (~(HEADER_DATA)0 << (class + 1));
+    if (larger == 0)
         return NULL;
-    while (header->next != NULL) {
-        bool joined = false;
-        if (header_isfree(header) && header_isfree(header->next)) {
-            coalesce(header);
-        }
-        header = joined ? header : header->next;
+    heap->scanned++;
+    return heap->bins[__builtin_ctzl(larger)];
+}
+
+//add a free region to the address ordered list, for first and next fit
+void list_insert(heap *heap, block_header *header) {
+    //find the free region just before it: a free left neighbour is, otherwise the
+    //finger may be, and failing that the list is walked from its start
+    block_header *prev = NULL;
+    block_header *finger = heap->finger;
+    block_header *right = header_next(header);
+    if (header_isprevfree(header)) {
+        prev = header_prev(header);
+    } else if (header_isfree(right) && !header_isend(right)) {
+        prev = LINKS_FROM_HEADER(right)->prev;
+    } else if (finger != NULL && finger < header
+            && (LINKS_FROM_HEADER(finger)->next == NULL || LINKS_FROM_HEADER(finger)->next > header)) {
+        prev = finger;
+    } else {
+        for (block_header *next = heap->list; next != NULL && next < header; next = LINKS_FROM_HEADER(next)->next)
+            prev = next;
     }
-    return header;
+    free_links *links = LINKS_FROM_HEADER(header);
+    links->prev = prev;
+    links->next = prev != NULL ? LINKS_FROM_HEADER(prev)->next : heap->list;
+    if (links->next != NULL)
+        LINKS_FROM_HEADER(links->next)->prev = header;
+    if (prev != NULL)
+        LINKS_FROM_HEADER(prev)->next = header;
+    else
+        heap->list = header;
+    heap->finger = header;
 }
 
-//deallocate regions that should be removed as fit; pass header as a hint.
-void clean(block_header *header) {
-    if (header == NULL)
-        return;
-    while (header != NULL && header->next != NULL) {
-        //if we can deallocate this region as a multiple of page sizes...
-        if (header_isend(header->next) && (header_getsize(header) + 2 * sizeof(block_header)) % getpagesize() == 0) {
-            //remove the page from the linked list
-            block_header *nextPage = header->next == NULL ? NULL : header->next->next;
-            if (nextPage != NULL)
-                nextPage->prev = header->prev;
-            if (header->prev != NULL) {
-                header->prev->next = nextPage;
-            } else {
-                //this must be the root if the previous pointer is null
-                assert(header == ROOT);
-                //reassign the ROOT
-                ROOT = nextPage;
-            }
-            //deallocate its space
-            //printf("found empty page %p through %p; deallocating\n", (void*)header, (void*)header->next + sizeof(block_header));
-            munmap(header, header_getsize(header) + 2 * sizeof(block_header));
-            header = nextPage;
-        //... or check for page-end headers
-        } else if (header_isend(header)) {
-            //if the next page is empty (and it is the last page) then deallocate it
-            block_header *page = header->next;
-            block_header *nextPage = page->next->next == NULL ? NULL : page->next->next;
-            if (page != NULL && (page->next == NULL || header_isend(page->next))) {
-                //printf("found empty page %p through %p; deallocating\n", (void*)page, (void*)page->next + sizeof(block_header));
-                munmap(page, header_getsize(page) + 2 * sizeof(block_header));
-                //if next is null then page is the last page in the list
-                header->next = nextPage;
-                nextPage->prev = header;
+//remove a free region from the address ordered list
+void list_remove(heap *heap, block_header *header) {
+    free_links *links = LINKS_FROM_HEADER(header);
+    if (links->prev != NULL)
+        LINKS_FROM_HEADER(links->prev)->next = links->next;
+    else
+        heap->list = links->next;
+    if (links->next != NULL)
+        LINKS_FROM_HEADER(links->next)->prev = links->prev;
+    //what is split off the region, or merged into it, goes back in its place
+    heap->finger = links->prev;
+    if (heap->rover == header)
+        heap->rover = links->prev;
+}
+
+//return the first free region with at least size bytes in address order, starting
+//from the rover for next fit
+block_header *list_find(heap *heap, size_t size) {
+    block_header *start = heap->list;
+    if (POLICY == MYALLOC_NEXT_FIT && heap->rover != NULL)
+        start = LINKS_FROM_HEADER(heap->rover)->next;
+    //next fit wraps around to the start of the list, and stops where it began
+    for (int pass = 0; pass < 2; pass++) {
+        block_header *end = pass == 0 ? NULL : start;
+        block_header *header = pass == 0 ? start : heap->list;
+        for (; header != end; header = LINKS_FROM_HEADER(header)->next) {
+            heap->scanned++;
+            if (header_getsize(header) >= size) {
+                //the search goes on from whatever is left of the region in its place
+                heap->rover = LINKS_FROM_HEADER(header)->prev;
+                return header;
             }
         }
-        header = header != NULL ? header->next : NULL;
+        if (start == heap->list)
+            break;
     }
+    return NULL;
 }
 
-//print a visual representation of the memory starting from header, moving right
-void header_print(block_header *header) {
-    if (header != NULL) {
-        while (header->next != NULL) {
-            if (header == ROOT)
-                printf("|ROOT|");
-            else if (header_isend(header) && header->next != NULL)
-                printf("|END|  >  ");
-            else if (header->next == NULL)
-                printf("|END|");
-            else
-                printf("|HEAD|");
+//return whether the key (size, key) orders before, after or the same as the node: a
+//negative number, a positive one, or 0
+static int tree_compare(size_t size, block_header *key, block_header *node) {
+    if (size != header_getsize(node))
+        return size < header_getsize(node) ? -1 : 1;
+    return key == node ? 0 : key < node ? -1 : 1;
+}
 
-            int size = header_getsize(header);
-            if (size > 0) {
-                if (header_isfree(header))
-                    printf("___%i___", size);
-                else
-                    printf("***%i***", size);
+//splay the node of the tree under root closest to the key (size, key) up to the root,
+//adding the nodes looked at to visited if not NULL; return the new root
+block_header *tree_splay(block_header *root, size_t size, block_header *key, unsigned long *visited) {
+    if (root == NULL)
+        return NULL;
+    //top-down: the nodes passed on the way are hung off the two sides of the new root,
+    //collected from assembly.next (left side) and assembly.prev (right side)
+    free_links assembly = {NULL, NULL};
+    free_links *left = &assembly;
+    free_links *right = &assembly;
+    block_header *node = root;
+    while (true) {
+        if (visited != NULL)
+            (*visited)++;
+        int order = tree_compare(size, key, node);
+        if (order < 0) {
+            block_header *child = LINKS_FROM_HEADER(node)->prev;
+            if (child == NULL)
+                break;
+            if (tree_compare(size, key, child) < 0) {
+                //rotate right
+                LINKS_FROM_HEADER(node)->prev = LINKS_FROM_HEADER(child)->next;
+                LINKS_FROM_HEADER(child)->next = node;
+                node = child;
+                if (LINKS_FROM_HEADER(node)->prev == NULL)
+                    break;
+            }
+            right->prev = node;
+            right = LINKS_FROM_HEADER(node);
+            node = LINKS_FROM_HEADER(node)->prev;
+        } else if (order > 0) {
+            block_header *child = LINKS_FROM_HEADER(node)->next;
+            if (child == NULL)
+                break;
+            if (tree_compare(size, key, child) > 0) {
+                //rotate left
+                LINKS_FROM_HEADER(node)->next = LINKS_FROM_HEADER(child)->prev;
+                LINKS_FROM_HEADER(child)->prev = node;
+                node = child;
+                if (LINKS_FROM_HEADER(node)->next == NULL)
+                    break;
             }
-            header = header->next;
+            left->next = node;
+            left = LINKS_FROM_HEADER(node);
+            node = LINKS_FROM_HEADER(node)->next;
+        } else {
+            break;
         }
-        printf("|END|\n");
     }
+    left->next = LINKS_FROM_HEADER(node)->prev;
+    right->prev = LINKS_FROM_HEADER(node)->next;
+    LINKS_FROM_HEADER(node)->prev = assembly.next;
+    LINKS_FROM_HEADER(node)->next = assembly.prev;
+    return node;
+}
+
+//add a free region to the tree of free regions by size, for best fit
+void tree_insert(heap *heap, block_header *header) {
+    free_links *links = LINKS_FROM_HEADER(header);
+    block_header *root = tree_splay(heap->tree, header_getsize(header), header, NULL);
+    links->prev = NULL;
+    links->next = NULL;
+    if (root != NULL && tree_compare(header_getsize(header), header, root) < 0) {
+        links->prev = LINKS_FROM_HEADER(root)->prev;
+        links->next = root;
+        LINKS_FROM_HEADER(root)->prev = NULL;
+    } else if (root != NULL) {
+        links->next = LINKS_FROM_HEADER(root)->next;
+        links->prev = root;
+        LINKS_FROM_HEADER(root)->next = NULL;
+    }
+    heap->tree = header;
+}
+
+//remove a free region from the tree of free regions by size
+void tree_remove(heap *heap, block_header *header) {
+    size_t size = header_getsize(header);
+    block_header *root = tree_splay(heap->tree, size, header, NULL);
+    assert(root == header);
+    free_links *links = LINKS_FROM_HEADER(root);
+    if (links->prev == NULL) {
+        heap->tree = links->next;
+    } else {
+        //everything on the left orders before the key, so its last node comes up, with
+        //no right child to take the place of the removed node's right side
+        heap->tree = tree_splay(links->prev, size, header, NULL);
+        LINKS_FROM_HEADER(heap->tree)->next = links->next;
+    }
+}
+
+//return the smallest free region with at least size bytes from the tree
+block_header *tree_find(heap *heap, size_t size) {
+    //no region is at address NULL, so the key orders before every region of the size
+    heap->tree = tree_splay(heap->tree, size, NULL, &heap->scanned);
+    block_header *header = heap->tree;
+    if (header == NULL || header_getsize(header) >= size)
+        return header;
+    //the root is the largest region too small, the fit is the first one after it
+    header = LINKS_FROM_HEADER(header)->next;
+    while (header != NULL && LINKS_FROM_HEADER(header)->prev != NULL) {
+        heap->scanned++;
+        header = LINKS_FROM_HEADER(header)->prev;
+    }
+    return header;
 }
 
 /*--- BIT-TWIDDLING ---*/
-
-//return the corresponding region size from the header's data segment
-int header_getsize(block_header *header) {
-    int d = header->data;
-    //MSB is reserved for free-bit, the rest is size data; mask everything except free-bit
-    return d & ~((HEADER_DATA)1 << HEADER_FREE_BIT);
-}
-
-//set the size value for the header to the value of size
-//warning, the msb of the size field is ignored!
-void header_setsize(block_header *header, int size) {
-    bool free = header_isfree(header);
-    header->data = size;
-    header_setfree(header, free);
-}
-
-//return true if the region this header corresponds to is marked as free
-bool header_isfree(block_header *header) {
-    //since the msb is also the sign-bit, we can simply check if the data segment is < 0
-    return (header->data & ((HEADER_DATA)1 << HEADER_FREE_BIT)) != 0;
-}
-
-//set the header's free-flag to the value of free
-void header_setfree(block_header *header, bool free) {
-    //set the MSB to 1 if true, 0 otherwise
-    if (free)
-        header->data |= ((HEADER_DATA)1 << HEADER_FREE_BIT);
-    else
-        header->data &= ~((HEADER_DATA)1 << HEADER_FREE_BIT);
-}
-
-//return true if the header's page-end-bit is set
-bool header_isend(block_header *header) {
-    return (header->data & ((HEADER_DATA)1 << HEADER_PAGE_END_BIT)) != 0;
-}
-
-//set the header's page-eng-flag to the value of end
-void header_setend(block_header *header, bool end) {
-    //set the MSB to 1 if true, 0 otherwise
-    if (end)
-        header->data |= ((HEADER_DATA)1 << HEADER_PAGE_END_BIT);
-    else
-        header->data &= ~((HEADER_DATA)1 << HEADER_PAGE_END_BIT);
-}
+
+//return the header of the region to the right, which is a page-end if header is last
+block_header *header_next(block_header *header) {
+    return REGION_FROM_HEADER(header) + header_getsize(header);
+}
+
+//return the header of the region to the left, only valid if header_isprevfree(header)
+block_header *header_prev(block_header *header) {
+    //a free region's size is repeated in the word just before this header
+    HEADER_DATA size = *((HEADER_DATA*)header - 1);
+    return (void*)header - size - sizeof(block_header);
+}
+
+//return the corresponding region size from the header's data segment
+size_t header_getsize(block_header *header) {
+    //the top bits are reserved for the flags and heap index, the rest is size data
+    return header->data & SIZE_MASK;
+}
+
+//set the size value for the header to the value of size
+//warning, bits of the size overlapping the flags and heap index are ignored!
+void header_setsize(block_header *header, size_t size) {
+    header->data = (header->data & ~SIZE_MASK) | (size & SIZE_MASK);
+}
+
+//return true if the region this header corresponds to is marked as free
+bool header_isfree(block_header *header) {
+    //since the msb is also the sign-bit, we can simply check if the data segment is < 0
+    return (header->data & ((HEADER_DATA)1 << HEADER_FREE_BIT)) != 0;
+}
+
+//set the header's free-flag to the value of free
+void header_setfree(block_header *header, bool free) {
+    //set the MSB to 1 if true, 0 otherwise
+    if (free)
+        header->data |= ((HEADER_DATA)1 << HEADER_FREE_BIT);
+    else
+        header->data &= ~((HEADER_DATA)1 << HEADER_FREE_BIT);
+}
+
+//return true if the header's page-end-bit is set
+bool header_isend(block_header *header) {
+    return (header->data & ((HEADER_DATA)1 << HEADER_PAGE_END_BIT)) != 0;
+}
+
+//set the header's page-eng-flag to the value of end
+void header_setend(block_header *header, bool end) {
+    //set the MSB to 1 if true, 0 otherwise
+    if (end)
+        header->data |= ((HEADER_DATA)1 << HEADER_PAGE_END_BIT);
+    else
+        header->data &= ~((HEADER_DATA)1 << HEADER_PAGE_END_BIT);
+}
+
+//return the heap owning the region this header corresponds to
+heap *header_getheap(block_header *header) {
+    return &HEAPS[(header->data >> HEADER_HEAP_SHIFT) & (MAX_HEAPS - 1)];
+}
+
+//set the heap owning the region this header corresponds to
+void header_setheap(block_header *header, heap *heap) {
+    header->data &= ~((HEADER_DATA)(MAX_HEAPS - 1) << HEADER_HEAP_SHIFT);
+    header->data |= (HEADER_DATA)heap->index << HEADER_HEAP_SHIFT;
+}
+
+//return true if the header's mapped-bit is set
+bool header_ismapped(block_header *header) {
+    return (header->data & ((HEADER_DATA)1 << HEADER_MAPPED_BIT)) != 0;
+}
+
+//set the header's mapped-flag to the value of mapped
+void header_setmapped(block_header *header, bool mapped) {
+    if (mapped)
+        header->data |= ((HEADER_DATA)1 << HEADER_MAPPED_BIT);
+    else
+        header->data &= ~((HEADER_DATA)1 << HEADER_MAPPED_BIT);
+}
+
+//return true if the header's prev-free-bit is set
+bool header_isprevfree(block_header *header) {
+    return (header->data & ((HEADER_DATA)1 << HEADER_PREV_FREE_BIT)) != 0;
+}
+
+//set the header's prev-free-flag to the value of free
+void header_setprevfree(block_header *header, bool free) {
+    if (free)
+        header->data |= ((HEADER_DATA)1 << HEADER_PREV_FREE_BIT);
+    else
+        header->data &= ~((HEADER_DATA)1 << HEADER_PREV_FREE_BIT);
+}
+
+//return true if the header's page-start-bit is set
+bool header_isstart(block_header *header) {
+    return (header->data & ((HEADER_DATA)1 << HEADER_PAGE_START_BIT)) != 0;
+}
+
+//set the header's page-start-flag to the value of start
+void header_setstart(block_header *header, bool start) {
+    if (start)
+        header->data |= ((HEADER_DATA)1 << HEADER_PAGE_START_BIT);
+    else
+        header->data &= ~((HEADER_DATA)1 << HEADER_PAGE_START_BIT);
+}
@@ -1,7 +1,165 @@
-/*	Allocate 'size' bytes of memory. On success the function returns a pointer to 
-	the start of the allocated region. On failure NULL is returned. */
-extern void *myalloc(int size);
-
-/*	Release the region of memory pointed to by 'ptr'. */
-extern void myfree(void *ptr);
-
+#ifndef MYALLOC_H
+#define MYALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	Allocate 'size' bytes of memory. On success the function returns a pointer to 
+	the start of the allocated region, which is aligned to 16 bytes. On failure NULL
+	is returned. */
+extern void *myalloc(size_t size);
+
+/*	Release the region of memory pointed to by 'ptr'. With MYALLOC_HARDENED set to "on",
+	releasing a region twice, a pointer that was never allocated, or a region written
+	past its usable size aborts the program with a message, and released regions are
+	held back from reuse for a while, MYALLOC_QUARANTINE bytes of them per thread.
+	Hardened mode makes allocating and releasing a fifth to a half slower, the most for
+	mixed sizes across threads, which makes it a tool for testing and for programs that
+	value catching misuse over speed. */
+extern void myfree(void *ptr);
+
+/*	Release the region of memory pointed to by 'ptr', allocated by myalloc or mycalloc
+	with 'size' bytes, 'count * size' for mycalloc, as myfree does. Knowing the size
+	spares a small region from having its size looked up, so it goes straight back to
+	the calling thread's cache. A region that was resized, or allocated by
+	myaligned_alloc, is released with myfree instead. */
+extern void myfree_sized(void *ptr, size_t size);
+
+/*	Resize the region of memory pointed to by 'ptr' to 'size' bytes, keeping its
+	contents up to the smaller of the old and new sizes. The region may move, in which
+	case the returned pointer differs from 'ptr'. If 'ptr' is NULL this is myalloc(size),
+	if 'size' is 0 this is myfree(ptr) and NULL is returned. On failure NULL is returned
+	and the original region is left untouched. */
+extern void *myrealloc(void *ptr, size_t size);
+
+/*	Allocate a zeroed region for 'count' elements of 'size' bytes each. On success the
+	function returns a pointer to the start of the allocated region. On failure, or if
+	'count * size' overflows, NULL is returned. */
+extern void *mycalloc(size_t count, size_t size);
+
+/*	Allocate 'size' bytes of memory starting at an address which is a multiple of
+	'alignment', which must be a power of two. On success the function returns a
+	pointer to the start of the allocated region. On failure NULL is returned. The
+	region is released with myfree. */
+extern void *myaligned_alloc(size_t alignment, size_t size);
+
+/*	Return the number of bytes the region pointed to by 'ptr' can hold, which is at least
+	the size it was allocated with. If 'ptr' is NULL, 0 is returned. */
+extern size_t myalloc_usable_size(void *ptr);
+
+/*	Allocate 'count' regions of 'size' bytes each, as many calls of myalloc would, storing
+	pointers to them in 'regions'. The calling thread's heap is locked only once for the
+	whole batch, and regions too large for the thread cache are carved out of a single
+	free region, so they end up next to each other. The number of regions allocated is
+	returned, which is less than 'count' only if memory ran out; the first that many
+	entries of 'regions' are filled in. */
+extern size_t myalloc_bulk(size_t size, size_t count, void **regions);
+
+/*	Release the 'count' regions pointed to by 'regions', as many calls of myfree would;
+	NULL entries are skipped. Regions that lie next to each other, as those allocated by
+	one call of myalloc_bulk do, are merged before being given back, so a batch freed in
+	the order it was allocated costs little more than a single region. */
+extern void myfree_bulk(void **regions, size_t count);
+
+/*	An arena, for objects that all die together: they are handed out one after another
+	from pages the arena holds, without a header each, and released all at once by
+	resetting or destroying the arena. An arena must only be used by one thread at a
+	time. */
+typedef struct myarena myarena;
+
+/*	Create an empty arena, taking its first pages from the calling thread's heap. On
+	failure NULL is returned. */
+extern myarena *myarena_create(void);
+
+/*	Allocate 'size' bytes from 'arena'. On success the function returns a pointer to the
+	start of the allocated region, which is aligned to 16 bytes; on failure NULL is
+	returned. The region must not be passed to myfree or myrealloc. */
+extern void *myarena_alloc(myarena *arena, size_t size);
+
+/*	Release every region allocated from 'arena' at once, in constant time. The arena
+	keeps its pages, and hands them out again from the start. */
+extern void myarena_reset(myarena *arena);
+
+/*	Release every region allocated from 'arena', and the arena itself, giving its pages
+	back to the heap. */
+extern void myarena_destroy(myarena *arena);
+
+/*	The placement policies, deciding which free region an allocation is carved from:
+	the first in address order to fit (first fit), the first to fit after the one
+	the last allocation came from (next fit), the smallest to fit (best fit), or the
+	first to fit in the free list of the smallest size class that can hold the request
+	(segregated fit, the default). */
+enum myalloc_policy {
+	MYALLOC_SEGREGATED_FIT,
+	MYALLOC_FIRST_FIT,
+	MYALLOC_NEXT_FIT,
+	MYALLOC_BEST_FIT
+};
+
+/*	Choose the placement policy. The policy can also be chosen by setting MYALLOC_POLICY
+	to "segregated", "first-fit", "next-fit" or "best-fit". It can only change while
+	there is no free space in the heaps, as before the first allocation. On success 0 is
+	returned, otherwise -1, and the policy is left as it was. */
+extern int myalloc_set_policy(enum myalloc_policy policy);
+
+/*	A snapshot of the allocator's counters, as filled in by myalloc_stats. Regions held
+	by the threads' caches of freed regions count as in use, as do regions freed by a
+	thread other than the one whose heap they came from, until that heap is next
+	allocated from. */
+struct myalloc_stats {
+	size_t mapped;			/* bytes mapped from the system, retained pages included */
+	size_t in_use;			/* bytes in regions handed out */
+	size_t free;			/* bytes in free regions */
+	size_t free_by_class[64];	/* free bytes per size class, class n holding regions of
+					   2^n up to 2^(n+1) bytes */
+	size_t largest_free;		/* size of the largest free region */
+	double fragmentation;		/* 1 - largest_free / free, 0 when nothing is free */
+	size_t retained;		/* bytes of empty pages kept for reuse and not yet purged */
+	unsigned long mmaps;		/* calls made to map memory */
+	unsigned long munmaps;		/* calls made to unmap memory */
+	double scanned_per_alloc;	/* free regions looked at per allocation from the free
+					   lists */
+};
+
+/*	Fill in 'stats' with the allocator's current counters. The counters are kept up to
+	date as the allocator runs, so this is cheap enough to call periodically. */
+extern void myalloc_stats(struct myalloc_stats *stats);
+
+/*	Hand the memory of free space back to the system, so that the process's resident
+	set follows the bytes in use rather than its peak. A page is otherwise only given
+	back once every region in it is free; this also releases the whole pages inside
+	free regions between regions still in use, the space of empty pages kept for reuse,
+	and first returns the regions cached by the calling thread to their heaps. The
+	memory stays mapped, and is handed out again as usual. The number of bytes released
+	is returned. The heaps also release a large free region between regions in use
+	themselves as it is freed, at most once every MYALLOC_TRIM_MS milliseconds (10
+	seconds by default, 0 for never). */
+extern size_t myalloc_trim(void);
+
+/*	Write a dump of the heaps to the file at 'path', in the format of heapdump.h: every
+	page of every heap, with the bytes in use and free in it, a map of how full each
+	system page of it is and whether it is resident, and each heap's free regions by
+	size class. The heaps are walked one at a time, each locked only while its pages
+	are gone over, so the dump can be taken from a running program; the heatmap tool
+	renders it. On success 0 is returned, otherwise -1. */
+extern int myalloc_heap_dump(const char *path);
+
+/*	Write a heap profile to the file at 'path', in the legacy heap profile format read
+	by pprof. Profiling is on when MYALLOC_PROFILE_RATE is set to the number of bytes
+	allocated between samples on average, or when MYALLOC_PROFILE is set, in which case
+	the default rate of 512 KiB is used; a profile lists the call stacks of the sampled
+	allocations, with how many of them, and of their bytes, are still in use and have
+	been allocated in total. With MYALLOC_PROFILE set to a path prefix, a process sent
+	SIGUSR2 also writes a profile, to '<prefix>.<pid>.<n>.heap', at its next sampled
+	allocation. On success 0 is returned; -1 is returned if profiling is off or the file
+	could not be written. */
+extern int myalloc_profile_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef MYALLOC_HPP
+#define MYALLOC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+#include "myalloc.h"
+
+/*	Allocators for the C++ standard containers, on top of myalloc. They live in the
+	namespace myalloc_cxx, as myalloc itself already names the C function.
+
+	std::vector<int, myalloc_cxx::allocator<int>> numbers;
+	std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+		myalloc_cxx::allocator<std::pair<const int, int>>> counts;
+
+	myalloc_cxx::arena arena;
+	std::vector<int, myalloc_cxx::arena_allocator<int>> scratch(arena);
+
+	std::pmr::vector<int> values(myalloc_cxx::heap_resource());
+
+	Everything here is inline and calls the C functions directly, so a container using
+	allocator costs no more per call than myalloc and myfree_sized themselves. Regions
+	are given back with the size they were allocated with, which spares the allocator
+	looking it up. Types aligned to more than 16 bytes are allocated with
+	myaligned_alloc. Failures throw std::bad_alloc. */
+
+namespace myalloc_cxx {
+
+namespace detail {
+
+/*	The alignment every region of myalloc has. */
+constexpr std::size_t natural_alignment = 16;
+
+inline void *allocate(std::size_t bytes, std::size_t alignment) {
+	void *region = alignment <= natural_alignment ? myalloc(bytes) : myaligned_alloc(alignment, bytes);
+	if (region == nullptr)
+		throw std::bad_alloc();
+	return region;
+}
+
+inline void deallocate(void *region, std::size_t bytes, std::size_t alignment) noexcept {
+	if (alignment <= natural_alignment)
+		myfree_sized(region, bytes);
+	else
+		myfree(region);
+}
+
+template <typename T>
+inline std::size_t array_bytes(std::size_t count) {
+	if (count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+		throw std::bad_array_new_length();
+	return count * sizeof(T);
+}
+
+}
+
+/*	An allocator taking its regions from the heaps, like myalloc. It has no state, so
+	every instance is interchangeable with every other. */
+template <typename T>
+class allocator {
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type is_always_equal;
+
+	allocator() noexcept {}
+
+	template <typename U>
+	allocator(const allocator<U> &) noexcept {}
+
+	T *allocate(std::size_t count) {
+		return static_cast<T*>(detail::allocate(detail::array_bytes<T>(count), alignof(T)));
+	}
+
+	void deallocate(T *region, std::size_t count) noexcept {
+		detail::deallocate(region, count * sizeof(T), alignof(T));
+	}
+};
+
+template <typename T, typename U>
+inline bool operator==(const allocator<T> &, const allocator<U> &) noexcept {
+	return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const allocator<T> &, const allocator<U> &) noexcept {
+	return false;
+}
+
+/*	An arena of myarena_create, for the objects of one container or one task, which
+	are all released together when the arena is reset or destroyed. It is neither
+	copied nor moved, as allocators refer to it. */
+class arena {
+public:
+	arena() : handle(myarena_create()) {
+		if (handle == nullptr)
+			throw std::bad_alloc();
+	}
+
+	~arena() {
+		myarena_destroy(handle);
+	}
+
+	arena(const arena &) = delete;
+	arena &operator=(const arena &) = delete;
+
+	/*	Allocate 'bytes' bytes aligned to 'alignment', a power of two. */
+	void *allocate(std::size_t bytes, std::size_t alignment = detail::natural_alignment) {
+		//a larger alignment is made up for by allocating that much more
+		std::size_t extra = alignment > detail::natural_alignment ? alignment - detail::natural_alignment : 0;
+		if (bytes > std::numeric_limits<std::size_t>::max() - extra)
+			throw std::bad_alloc();
+		void *region = myarena_alloc(handle, bytes + extra);
+		if (region == nullptr)
+			throw std::bad_alloc();
+		return reinterpret_cast<void*>((reinterpret_cast<std::uintptr_t>(region) + alignment - 1) & ~(alignment - 1));
+	}
+
+	/*	Release everything allocated from the arena, which keeps its pages for what is
+		allocated next. Containers using it must be done with by then. */
+	void reset() noexcept {
+		myarena_reset(handle);
+	}
+
+	myarena *get() const noexcept {
+		return handle;
+	}
+
+private:
+	myarena *handle;
+};
+
+/*	An allocator taking its regions from an arena, which releases them: deallocating
+	does nothing. Allocators of the same arena are interchangeable. A container is
+	given its arena on construction:
+
+	std::vector<int, myalloc_cxx::arena_allocator<int>> scratch(arena); */
+template <typename T>
+class arena_allocator {
+public:
+	typedef T value_type;
+
+	arena_allocator(arena &source) noexcept : source(&source) {}
+
+	template <typename U>
+	arena_allocator(const arena_allocator<U> &other) noexcept : source(other.source) {}
+
+	T *allocate(std::size_t count) {
+		return static_cast<T*>(source->allocate(detail::array_bytes<T>(count), alignof(T)));
+	}
+
+	void deallocate(T *, std::size_t) noexcept {}
+
+	arena *source;
+};
+
+template <typename T, typename U>
+inline bool operator==(const arena_allocator<T> &a, const arena_allocator<U> &b) noexcept {
+	return a.source == b.source;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const arena_allocator<T> &a, const arena_allocator<U> &b) noexcept {
+	return a.source != b.source;
+}
+
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+
+/*	A memory resource taking its regions from the heaps, for the std::pmr containers,
+	as returned by heap_resource. Unlike allocator, each call goes through the
+	resource's virtual functions. */
+class heap_memory_resource : public std::pmr::memory_resource {
+protected:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+		return detail::allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void *region, std::size_t bytes, std::size_t alignment) override {
+		detail::deallocate(region, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		return dynamic_cast<const heap_memory_resource*>(&other) != nullptr;
+	}
+};
+
+/*	Return the resource of the heaps. It is never destroyed, so containers outliving
+	the end of main can still release their regions. */
+inline std::pmr::memory_resource *heap_resource() noexcept {
+	alignas(heap_memory_resource) static unsigned char storage[sizeof(heap_memory_resource)];
+	static heap_memory_resource *resource = ::new (storage) heap_memory_resource;
+	return resource;
+}
+
+/*	A memory resource owning an arena, like std::pmr::monotonic_buffer_resource:
+	deallocating does nothing, and release, or destroying the resource, releases
+	everything allocated from it at once. */
+class arena_resource : public std::pmr::memory_resource {
+public:
+	/*	Release everything allocated from the resource. */
+	void release() noexcept {
+		source.reset();
+	}
+
+protected:
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+		return source.allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void *, std::size_t, std::size_t) override {}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		return this == &other;
+	}
+
+private:
+	arena source;
+};
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+/*
+ * The standard allocation functions, implemented on top of myalloc, so that libmyalloc.so
+ * can stand in for the C library's malloc in any program:
+ *
+ * LD_PRELOAD=./libmyalloc.so program
+ *
+ * Every function that hands out or takes back memory of the C library's malloc is
+ * replaced, memalign, valloc and friends included, so that no region of one allocator
+ * ever reaches the other. Only these and the myalloc API are exported from the library,
+ * see libmyalloc.map; everything internal to the allocator stays hidden, so it cannot
+ * clash with the host program's own symbols.
+ */
+
+void *malloc(size_t size) {
+    void *ptr = myalloc(size);
+    if (ptr == NULL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+void free(void *ptr) {
+    myfree(ptr);
+}
+
+void *realloc(void *ptr, size_t size) {
+    void *moved = myrealloc(ptr, size);
+    if (moved == NULL && size != 0)
+        errno = ENOMEM;
+    return moved;
+}
+
+void *calloc(size_t count, size_t size) {
+    void *ptr = mycalloc(count, size);
+    if (ptr == NULL)
+        errno = ENOMEM;
+    return ptr;
+}
+
+void *reallocarray(void *ptr, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, count * size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *ptr = myaligned_alloc(alignment, size);
+    if (ptr == NULL)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = myaligned_alloc(alignment, size);
+    if (ptr == NULL)
+        errno = (alignment & (alignment - 1)) != 0 || alignment == 0 ? EINVAL : ENOMEM;
+    return ptr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size) {
+    return aligned_alloc(getpagesize(), size);
+}
+
+void *pvalloc(size_t size) {
+    size_t page = getpagesize();
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr) {
+    return myalloc_usable_size(ptr);
+}
+
+//the padding glibc leaves at the top of its heap has no counterpart here
+int malloc_trim(size_t pad) {
+    return myalloc_trim() > 0;
+}
+
+/*--- C++ ---*/
+
+/*
+ * The C++ allocation operators, under their mangled names. A failing operator new
+ * calls the program's new handler until it either frees enough memory or gives up,
+ * then throws std::bad_alloc. The libstdc++ functions for that are only referenced
+ * weakly, so that C programs do not need libstdc++ to load the library; any program
+ * calling operator new has it.
+ */
+
+typedef void (*new_handler)();
+extern new_handler _ZSt15get_new_handlerv() __attribute__((weak));
+extern void _ZSt17__throw_bad_allocv() __attribute__((weak, noreturn));
+
+//the alignment argument of the aligned operators
+typedef size_t align_val_t;
+//the std::nothrow argument of the nothrow operators, which is never looked at
+typedef struct nothrow_t nothrow_t;
+
+//allocate size bytes with the given alignment as operator new does; throw std::bad_alloc
+//on failure if throwing, return NULL otherwise
+static void *new_region(size_t size, size_t alignment, bool throwing) {
+    while (true) {
+        void *ptr = alignment <= 16 ? myalloc(size) : myaligned_alloc(alignment, size);
+        if (ptr != NULL)
+            return ptr;
+        new_handler handler = _ZSt15get_new_handlerv != NULL ? _ZSt15get_new_handlerv() : NULL;
+        if (handler == NULL)
+            break;
+        handler();
+    }
+    if (throwing) {
+        if (_ZSt17__throw_bad_allocv != NULL)
+            _ZSt17__throw_bad_allocv();
+        abort();
+    }
+    return NULL;
+}
+
+//operator new(size_t) and operator new[](size_t)
+void *_Znwm(size_t size) {
+    return new_region(size, 0, true);
+}
+
+void *_Znam(size_t size) {
+    return new_region(size, 0, true);
+}
+
+//operator new(size_t, const std::nothrow_t&) and operator new[](size_t, const std::nothrow_t&)
+void *_ZnwmRKSt9nothrow_t(size_t size, const nothrow_t *nothrow) {
+    return new_region(size, 0, false);
+}
+
+void *_ZnamRKSt9nothrow_t(size_t size, const nothrow_t *nothrow) {
+    return new_region(size, 0, false);
+}
+
+//operator new(size_t, std::align_val_t) and operator new[](size_t, std::align_val_t)
+void *_ZnwmSt11align_val_t(size_t size, align_val_t alignment) {
+    return new_region(size, alignment, true);
+}
+
+void *_ZnamSt11align_val_t(size_t size, align_val_t alignment) {
+    return new_region(size, alignment, true);
+}
+
+//operator new(size_t, std::align_val_t, const std::nothrow_t&) and its array form
+void *_ZnwmSt11align_val_tRKSt9nothrow_t(size_t size, align_val_t alignment, const nothrow_t *nothrow) {
+    return new_region(size, alignment, false);
+}
+
+void *_ZnamSt11align_val_tRKSt9nothrow_t(size_t size, align_val_t alignment, const nothrow_t *nothrow) {
+    return new_region(size, alignment, false);
+}
+
+//operator delete(void*) and operator delete[](void*)
+void _ZdlPv(void *ptr) {
+    myfree(ptr);
+}
+
+void _ZdaPv(void *ptr) {
+    myfree(ptr);
+}
+
+//operator delete(void*, size_t) and operator delete[](void*, size_t), given the size
+//operator new was, which spares looking it up
+void _ZdlPvm(void *ptr, size_t size) {
+    myfree_sized(ptr, size);
+}
+
+void _ZdaPvm(void *ptr, size_t size) {
+    myfree_sized(ptr, size);
+}
+
+//operator delete(void*, const std::nothrow_t&) and operator delete[](void*, const std::nothrow_t&)
+void _ZdlPvRKSt9nothrow_t(void *ptr, const nothrow_t *nothrow) {
+    myfree(ptr);
+}
+
+void _ZdaPvRKSt9nothrow_t(void *ptr, const nothrow_t *nothrow) {
+    myfree(ptr);
+}
+
+//operator delete(void*, std::align_val_t) and operator delete[](void*, std::align_val_t)
+void _ZdlPvSt11align_val_t(void *ptr, align_val_t alignment) {
+    myfree(ptr);
+}
+
+void _ZdaPvSt11align_val_t(void *ptr, align_val_t alignment) {
+    myfree(ptr);
+}
+
+//operator delete(void*, size_t, std::align_val_t) and its array form
+void _ZdlPvmSt11align_val_t(void *ptr, size_t size, align_val_t alignment) {
+    myfree(ptr);
+}
+
+void _ZdaPvmSt11align_val_t(void *ptr, size_t size, align_val_t alignment) {
+    myfree(ptr);
+}
+
+//operator delete(void*, std::align_val_t, const std::nothrow_t&) and its array form
+void _ZdlPvSt11align_val_tRKSt9nothrow_t(void *ptr, align_val_t alignment, const nothrow_t *nothrow) {
+    myfree(ptr);
+}
+
+void _ZdaPvSt11align_val_tRKSt9nothrow_t(void *ptr, align_val_t alignment, const nothrow_t *nothrow) {
+    myfree(ptr);
+}
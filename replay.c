@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "myalloc.h"
+#include "trace.h"
+
+/*
+ * Replays a trace recorded with MYALLOC_TRACE against myalloc, see trace.h.
+ *
+ * usage: replay trace
+ *
+ * The trace is read back with trace_read, which puts its events in the order they
+ * happened, and replayed on a single thread, so that a run is repeatable: each allocation
+ * is made again with the size it was made with, and each release and resize applies to
+ * the region that replaced the one recorded. The report gives the time the replay took
+ * and the allocator's footprint over it, taken from myalloc_stats. The benchmark's replay
+ * workload (benchmark -r) runs the same traces against other allocators too.
+ */
+
+//the footprint is sampled once every this many operations
+#define SAMPLE_EVERY 1024
+
+static unsigned long now_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000UL + time.tv_nsec;
+}
+
+//replay one operation, with regions holding the region of each object
+static void replay_op(const trace_op *op, void **regions) {
+    switch (op->kind) {
+    case TRACE_ALLOC:
+        regions[op->id] = myalloc(op->size);
+        break;
+    case TRACE_CALLOC:
+        regions[op->id] = mycalloc(op->size, 1);
+        break;
+    case TRACE_ALIGNED:
+        regions[op->id] = myaligned_alloc(op->alignment, op->size);
+        break;
+    case TRACE_FREE:
+        myfree(regions[op->id]);
+        regions[op->id] = NULL;
+        break;
+    case TRACE_REALLOC:
+        regions[op->id] = myrealloc(regions[op->id], op->size);
+        break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace\n", argv[0]);
+        return 2;
+    }
+    trace_ops trace;
+    if (trace_read(argv[1], &trace) != 0) {
+        fprintf(stderr, "%s: cannot read trace %s\n", argv[0], argv[1]);
+        return 1;
+    }
+    void **regions = calloc(trace.ids + 1, sizeof(void*));
+    if (regions == NULL) {
+        fprintf(stderr, "%s: out of memory for the %u objects of trace %s\n", argv[0], trace.ids, argv[1]);
+        trace_discard(&trace);
+        return 1;
+    }
+
+    size_t peakMapped = 0;
+    size_t peakInUse = 0;
+    struct myalloc_stats stats;
+    unsigned long start = now_ns();
+    for (size_t i = 0; i < trace.count; i++) {
+        replay_op(&trace.ops[i], regions);
+        if (i % SAMPLE_EVERY == 0) {
+            myalloc_stats(&stats);
+            if (stats.mapped > peakMapped)
+                peakMapped = stats.mapped;
+            if (stats.in_use > peakInUse)
+                peakInUse = stats.in_use;
+        }
+    }
+    unsigned long elapsed = now_ns() - start;
+    //the footprint is taken with whatever the trace left live still allocated
+    myalloc_stats(&stats);
+    if (stats.mapped > peakMapped)
+        peakMapped = stats.mapped;
+    if (stats.in_use > peakInUse)
+        peakInUse = stats.in_use;
+    size_t live = 0;
+    for (uint32_t i = 0; i < trace.ids; i++)
+        live += regions[i] != NULL;
+
+    printf("operations  %zu (%zu events skipped, %lu dropped while tracing)\n", trace.count, trace.skipped, (unsigned long)trace.dropped);
+    printf("elapsed     %.3f ms, %.1f ns per operation\n", elapsed / 1e6, trace.count == 0 ? 0 : (double)elapsed / trace.count);
+    printf("peak mapped %zu bytes\n", peakMapped);
+    printf("peak in use %zu bytes\n", peakInUse);
+    printf("at the end  %zu bytes in use, %zu regions live\n", stats.in_use, live);
+    printf("fragmented  %.1f%% of free space outside the largest free region\n", 100 * stats.fragmentation);
+    free(regions);
+    trace_discard(&trace);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* This program allocates zeroed and aligned regions, and resizes regions in place */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+int main(int argc, char* argv[]){
+	int sizes[]={1,100,3000,50000,1000000};
+	int alignments[]={16,64,4096};
+	int i,j;
+	printf("%s starting\n",argv[0]);
+
+	// a region followed by free space grows without moving
+	char *a=(char*)myalloc(2000);
+	char *b=(char*)myalloc(2000);
+	set(a,2000,3);
+	myfree(b);
+	char *grown=(char*)myrealloc(a,3500);
+	if(grown!=a)check_failed(3);
+	check(grown,2000,3);
+	printf("TEST 1 PASSED - GREW IN PLACE\n");
+
+	// and shrinks without moving
+	char *shrunk=(char*)myrealloc(grown,1500);
+	if(shrunk!=grown)check_failed(4);
+	check(shrunk,1500,3);
+	myfree(shrunk);
+	printf("TEST 2 PASSED - SHRANK IN PLACE\n");
+
+	// zeroed regions, including ones reusing memory that was dirtied before
+	for(i=0;i<5;i++){
+		char *dirty=(char*)myalloc(sizes[i]);
+		set(dirty,sizes[i],0x55);
+		myfree(dirty);
+		char *p=(char*)mycalloc(sizes[i],1);
+		check(p,sizes[i],0);
+		myfree(p);
+	}
+	if(mycalloc(SIZE_MAX/8,16)!=NULL)check_failed(1);
+	printf("TEST 3 PASSED - ALLOCATED ZEROED REGIONS\n");
+
+	// aligned regions of every size
+	for(i=0;i<5;i++){
+		for(j=0;j<3;j++){
+			char *p=(char*)myaligned_alloc(alignments[j],sizes[i]);
+			if(((uintptr_t)p)%alignments[j]!=0)check_failed(alignments[j]);
+			set(p,sizes[i],j);
+			check(p,sizes[i],j);
+			myfree(p);
+		}
+	}
+	printf("TEST 4 PASSED - ALLOCATED ALIGNED REGIONS\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,61 @@
+/* This program repeatedly allocates and frees page sized regions, whose pages are
+   retained and reused, checking that reused pages hold no stale headers or contents */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+#define CYCLES 1000
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+int main(int argc, char* argv[]){
+	int page=getpagesize();
+	int i;
+	printf("%s starting\n",argv[0]);
+
+	// each cycle empties a page, which the next cycle takes back
+	char *keep=(char*)myalloc(page/2);
+	for(i=0;i<CYCLES;i++){
+		int bytes=page*(1+i%4)-64;
+		char *p=(char*)myalloc(bytes);
+		set(p,bytes,i);
+		check(p,bytes,i);
+		myfree(p);
+	}
+	printf("TEST 1 PASSED - CYCLED %i PAGE SIZED REGIONS\n",CYCLES);
+
+	// a zeroed region on a reused page must not see what was left there
+	for(i=0;i<CYCLES;i++){
+		int bytes=page*(1+i%4)-64;
+		char *dirty=(char*)myalloc(bytes);
+		set(dirty,bytes,0x55);
+		myfree(dirty);
+		char *p=(char*)mycalloc(bytes,1);
+		check(p,bytes,0);
+		myfree(p);
+	}
+	myfree(keep);
+	printf("TEST 2 PASSED - ZEROED REGIONS ON REUSED PAGES\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,58 @@
+/* This program checks that the allocator's statistics follow allocations and frees */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "myalloc.h"
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for statistic %i.",val);
+	exit(-1);
+}
+
+// the counters must always add up
+void check_consistent(struct myalloc_stats *stats){
+	size_t free=0;
+	int i;
+	for(i=0;i<64;i++)free+=stats->free_by_class[i];
+	if(free!=stats->free)check_failed(1);
+	if(stats->largest_free>stats->free)check_failed(2);
+	if(stats->in_use+stats->free>stats->mapped)check_failed(3);
+	if(stats->fragmentation<0||stats->fragmentation>1)check_failed(4);
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats before,after;
+	printf("%s starting\n",argv[0]);
+
+	// regions in the heap
+	myalloc_stats(&before);
+	check_consistent(&before);
+	char *p=(char*)myalloc(5000);
+	myalloc_stats(&after);
+	check_consistent(&after);
+	if(after.in_use<before.in_use+5000)check_failed(5);
+	if(after.scanned_per_alloc<0)check_failed(6);
+	myfree(p);
+	myalloc_stats(&before);
+	check_consistent(&before);
+	if(before.in_use+5000>after.in_use)check_failed(7);
+	// the space is either free, or retained along with its emptied page
+	if(before.largest_free<5000&&before.retained<5000)check_failed(8);
+	printf("TEST 1 PASSED - COUNTED A HEAP REGION\n");
+
+	// regions with mappings of their own
+	char *q=(char*)myalloc(1<<20);
+	myalloc_stats(&after);
+	check_consistent(&after);
+	if(after.mmaps!=before.mmaps+1)check_failed(9);
+	if(after.mapped<before.mapped+(1<<20))check_failed(10);
+	myfree(q);
+	myalloc_stats(&before);
+	check_consistent(&before);
+	if(before.munmaps!=after.munmaps+1)check_failed(11);
+	if(before.mapped+(1<<20)>after.mapped)check_failed(12);
+	printf("TEST 2 PASSED - COUNTED A MAPPED REGION\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,91 @@
+/* This program uses the standard allocation functions with libmyalloc.so standing in
+   for the C library's malloc, including across a fork while other threads allocate */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "myalloc.h"
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+volatile int stop=0;
+
+//keeps the heaps busy while the main thread forks
+void *worker(void *arg){
+	while(!stop){
+		char *p=(char*)malloc(100+rand()%3000);
+		set(p,100,1);
+		free(p);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats before,after;
+	void *aligned;
+	int i;
+	printf("%s starting\n",argv[0]);
+
+	// malloc must be served by myalloc
+	myalloc_stats(&before);
+	char *p=(char*)malloc(5000);
+	myalloc_stats(&after);
+	if(after.in_use<before.in_use+5000)check_failed(1);
+	if(malloc_usable_size(p)<5000)check_failed(2);
+	set(p,5000,2);
+	p=(char*)realloc(p,10000);
+	check(p,5000,2);
+	free(p);
+	char *q=(char*)calloc(100,10);
+	check(q,1000,0);
+	free(q);
+	if(posix_memalign(&aligned,256,1000)!=0||((uintptr_t)aligned)%256!=0)check_failed(3);
+	free(aligned);
+	if(posix_memalign(&aligned,3,1000)==0)check_failed(4);
+	printf("TEST 1 PASSED - ALLOCATED THROUGH THE STANDARD FUNCTIONS\n");
+
+	// a child forked while other threads allocate must be able to allocate too
+	pthread_t threads[4];
+	for(i=0;i<4;i++)pthread_create(&threads[i],NULL,worker,NULL);
+	for(i=0;i<20;i++){
+		pid_t pid=fork();
+		if(pid==0){
+			char *r=(char*)malloc(2000);
+			set(r,2000,3);
+			check(r,2000,3);
+			free(r);
+			_exit(0);
+		}
+		int status;
+		waitpid(pid,&status,0);
+		if(!WIFEXITED(status)||WEXITSTATUS(status)!=0)check_failed(5);
+	}
+	stop=1;
+	for(i=0;i<4;i++)pthread_join(threads[i],NULL);
+	printf("TEST 2 PASSED - ALLOCATED IN FORKED CHILDREN\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
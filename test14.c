@@ -0,0 +1,144 @@
+/* This program records a trace of the allocations of a copy of itself run with
+   MYALLOC_TRACE, and reads it back, as it is and as trace_read turns it into operations
+   on objects */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "myalloc.h"
+#include "trace.h"
+
+#define OBJECTS 1000
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//allocates and frees OBJECTS regions
+void *worker(void *arg){
+	char *objects[OBJECTS];
+	int i;
+	for(i=0;i<OBJECTS;i++){
+		objects[i]=(char*)myalloc(16+i);
+		set(objects[i],16+i,i);
+	}
+	for(i=0;i<OBJECTS;i++)myfree(objects[i]);
+	return NULL;
+}
+
+//the run traced, allocating from three threads
+int traced(){
+	pthread_t threads[2];
+	int i;
+	for(i=0;i<2;i++)pthread_create(&threads[i],NULL,worker,NULL);
+	char *p=(char*)myalloc(100);
+	p=(char*)myrealloc(p,5000);
+	char *q=(char*)mycalloc(10,10);
+	char *r=(char*)myaligned_alloc(256,1000);
+	myfree(p);
+	myfree(q);
+	myfree(r);
+	for(i=0;i<2;i++)pthread_join(threads[i],NULL);
+	return 0;
+}
+
+int main(int argc, char* argv[]){
+	char path[64];
+	int counts[6]={0};
+	int i,status;
+	if(argc>1&&strcmp(argv[1],"traced")==0)return traced();
+	printf("%s starting\n",argv[0]);
+	fflush(stdout);
+	snprintf(path,sizeof(path),"/tmp/myalloc-test14-%d.trace",(int)getpid());
+
+	// tracing is set up as the process starts, so the traced run is a new one
+	pid_t pid=fork();
+	if(pid==0){
+		setenv("MYALLOC_TRACE",path,1);
+		execl(argv[0],argv[0],"traced",(char*)NULL);
+		_exit(1);
+	}
+	waitpid(pid,&status,0);
+	if(!WIFEXITED(status)||WEXITSTATUS(status)!=0)check_failed(1);
+	printf("TEST 1 PASSED - TRACED A CHILD\n");
+
+	// every call is in the trace, and the file ends with the last event
+	FILE *file=fopen(path,"rb");
+	if(file==NULL)check_failed(2);
+	trace_header header;
+	if(fread(&header,sizeof(header),1,file)!=1)check_failed(3);
+	if(memcmp(header.magic,TRACE_MAGIC,8)!=0)check_failed(4);
+	if(header.events!=2*2*OBJECTS+7||header.dropped!=0)check_failed(5);
+	struct stat st;
+	stat(path,&st);
+	if(st.st_size!=sizeof(header)+header.events*sizeof(trace_event))check_failed(6);
+	trace_event *events=(trace_event*)malloc(header.events*sizeof(trace_event));
+	if(fread(events,sizeof(trace_event),header.events,file)!=header.events)check_failed(7);
+	fclose(file);
+	for(i=0;i<(int)header.events;i++){
+		if(events[i].kind<TRACE_ALLOC||events[i].kind>TRACE_REALLOC||events[i].thread>2)check_failed(8);
+		counts[events[i].kind]++;
+	}
+	if(counts[TRACE_ALLOC]!=2*OBJECTS+1||counts[TRACE_FREE]!=2*OBJECTS+3)check_failed(9);
+	if(counts[TRACE_CALLOC]!=1||counts[TRACE_ALIGNED]!=1||counts[TRACE_REALLOC]!=1)check_failed(10);
+	printf("TEST 2 PASSED - READ BACK THE TRACE\n");
+
+	// each thread's events are in order, its allocations freed after they were made
+	for(i=0;i<(int)header.events;i++){
+		int j;
+		if(events[i].kind==TRACE_REALLOC&&(events[i].size!=5000||events[i].previous==0))check_failed(11);
+		if(events[i].kind==TRACE_ALIGNED&&(events[i].previous!=256||events[i].address%256!=0))check_failed(12);
+		if(events[i].kind!=TRACE_FREE)continue;
+		for(j=i-1;j>=0;j--){
+			if(events[j].thread==events[i].thread&&events[j].time>events[i].time)check_failed(13);
+			if(events[j].thread==events[i].thread&&events[j].kind!=TRACE_FREE&&events[j].address==events[i].address)break;
+		}
+		if(j<0)check_failed(14);
+	}
+	printf("TEST 3 PASSED - EVENTS IN ORDER\n");
+
+	// every event becomes an operation, each object allocated before it is used and
+	// released once
+	trace_ops trace;
+	if(trace_read(path,&trace)!=0)check_failed(15);
+	unlink(path);
+	if(trace.count!=header.events||trace.skipped!=0||trace.dropped!=0)check_failed(16);
+	if(trace.ids==0||trace.ids>2*OBJECTS+3)check_failed(17);
+	char *live=(char*)calloc(trace.ids,1);
+	for(i=0;i<(int)trace.count;i++){
+		trace_op *op=&trace.ops[i];
+		if(op->id>=trace.ids)check_failed(18);
+		if(op->kind==TRACE_FREE){
+			if(!live[op->id])check_failed(19);
+			live[op->id]=0;
+		}else if(op->kind==TRACE_REALLOC){
+			if(!live[op->id]||op->size!=5000)check_failed(20);
+		}else{
+			if(live[op->id])check_failed(21);
+			if(op->kind==TRACE_ALIGNED&&op->alignment!=256)check_failed(22);
+			live[op->id]=1;
+		}
+	}
+	for(i=0;i<(int)trace.ids;i++)if(live[i])check_failed(23);
+	free(live);
+	trace_discard(&trace);
+	if(trace_read("/dev/null",&trace)!=-1)check_failed(24);
+	printf("TEST 4 PASSED - READ THE TRACE AS OPERATIONS\n");
+
+	free(events);
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
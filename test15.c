@@ -0,0 +1,64 @@
+/* This program checks which free region each placement policy allocates from */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "myalloc.h"
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+//allocates from free regions of 12000, 6000 and 9000 bytes, in that address order,
+//with the given policy
+void allocate_with(enum myalloc_policy policy){
+	if(myalloc_set_policy(policy)!=0)check_failed(1);
+	// one large free region, carved up from its start
+	char *large=(char*)myalloc(60000);
+	large=(char*)myrealloc(large,2000);
+	char *a=(char*)myalloc(12000);
+	char *s1=(char*)myalloc(5000);
+	char *b=(char*)myalloc(6000);
+	char *s2=(char*)myalloc(5000);
+	char *c=(char*)myalloc(9000);
+	char *s3=(char*)myalloc(5000);
+	if(!(a<s1&&s1<b&&b<s2&&s2<c&&c<s3))check_failed(2);
+	myfree(a);
+	myfree(b);
+	myfree(c);
+	if(myalloc_set_policy(MYALLOC_SEGREGATED_FIT)==0&&policy!=MYALLOC_SEGREGATED_FIT)check_failed(3);
+
+	char *p=(char*)myalloc(5000);
+	char *q=(char*)myalloc(8500);
+	if(policy==MYALLOC_BEST_FIT&&(p!=b||q!=c))check_failed(4);
+	if((policy==MYALLOC_FIRST_FIT||policy==MYALLOC_NEXT_FIT)&&(p!=a||q!=c))check_failed(5);
+	// first fit goes back to the start for the region freed there, next fit goes on
+	myfree(p);
+	char *r=(char*)myalloc(5000);
+	if(policy==MYALLOC_FIRST_FIT&&r!=a)check_failed(6);
+	if(policy==MYALLOC_NEXT_FIT&&r<s3)check_failed(7);
+	if(policy==MYALLOC_BEST_FIT&&r!=b)check_failed(8);
+	exit(0);
+}
+
+int main(int argc, char* argv[]){
+	const char *names[]={"SEGREGATED FIT","FIRST FIT","NEXT FIT","BEST FIT"};
+	int i,status;
+	printf("%s starting\n",argv[0]);
+	fflush(stdout);
+
+	// each policy gets a process of its own, where nothing has been allocated yet
+	for(i=MYALLOC_SEGREGATED_FIT;i<=MYALLOC_BEST_FIT;i++){
+		pid_t pid=fork();
+		if(pid==0)allocate_with((enum myalloc_policy)i);
+		waitpid(pid,&status,0);
+		if(!WIFEXITED(status)||WEXITSTATUS(status)!=0)check_failed(10+i);
+		printf("TEST %d PASSED - %s\n",i+1,names[i]);
+		fflush(stdout);
+	}
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,72 @@
+/* This program backs the heap with huge pages, checking that heap memory is mapped,
+   retained and reused in whole huge pages */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+#define HUGE_PAGE (2<<20)
+#define COUNT 1000
+#define SIZE 5000
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats stats;
+	char *regions[COUNT];
+	unsigned long mmaps;
+	int i,round;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used
+	setenv("MYALLOC_HUGEPAGES",argc>1?argv[1]:"thp",1);
+
+	// several huge pages worth of regions
+	for(i=0;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	for(i=0;i<COUNT;i++)check(regions[i],SIZE,i);
+	myalloc_stats(&stats);
+	if(stats.mapped<COUNT*SIZE||stats.mapped%HUGE_PAGE!=0)check_failed(1);
+	printf("TEST 1 PASSED - MAPPED HUGE PAGES\n");
+
+	// emptied huge pages are kept whole, and taken back without mapping more
+	for(round=0;round<3;round++){
+		for(i=0;i<COUNT;i++)myfree(regions[i]);
+		myalloc_stats(&stats);
+		if(stats.in_use!=0||stats.mapped%HUGE_PAGE!=0||stats.retained%HUGE_PAGE!=0)check_failed(2);
+		mmaps=stats.mmaps;
+		for(i=0;i<COUNT;i++){
+			regions[i]=(char*)myalloc(SIZE);
+			set(regions[i],SIZE,i);
+		}
+		myalloc_stats(&stats);
+		if(stats.mmaps!=mmaps)check_failed(3);
+	}
+	for(i=0;i<COUNT;i++){
+		check(regions[i],SIZE,i);
+		myfree(regions[i]);
+	}
+	printf("TEST 2 PASSED - REUSED HUGE PAGES\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
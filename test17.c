@@ -0,0 +1,103 @@
+/* This program runs the allocator on a fake topology of two NUMA nodes, checking that
+   heap memory and regions with mappings of their own are bound to their node, and that
+   regions freed on the other node go back to their own */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "myalloc.h"
+
+#define COUNT 200
+
+int sizes[]={64,500,2000};
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//allocates COUNT regions of each size
+void *allocate_regions(void *arg){
+	char **regions=(char**)arg;
+	int i;
+	for(i=0;i<3*COUNT;i++){
+		regions[i]=(char*)myalloc(sizes[i%3]);
+		set(regions[i],sizes[i%3],i);
+	}
+	return NULL;
+}
+
+//frees one region of each size allocated on the other node, which a thread would
+//otherwise get straight back from its cache, then allocates one of each size again
+void *exchange_regions(void *arg){
+	char **remote=(char**)arg;
+	char *local[3];
+	int i;
+	for(i=0;i<3;i++)myfree(remote[i]);
+	for(i=0;i<3;i++){
+		local[i]=(char*)myalloc(sizes[i]);
+		if(local[i]==remote[i])check_failed(2);
+	}
+	for(i=0;i<3;i++)myfree(local[i]);
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	char *first[3*COUNT],*second[3*COUNT],*third[3*COUNT];
+	pthread_t thread;
+	int i,mode;
+	unsigned long nodes;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used; this thread is on node 0, the next on node 1
+	setenv("MYALLOC_NUMA_FAKE","2",1);
+
+	allocate_regions(first);
+	pthread_create(&thread,NULL,allocate_regions,second);
+	pthread_join(thread,NULL);
+	for(i=0;i<3*COUNT;i++){
+		if(syscall(SYS_get_mempolicy,&mode,&nodes,sizeof(nodes)*8,first[i],MPOL_F_ADDR)!=0)check_failed(1);
+		if(mode!=MPOL_PREFERRED)check_failed(1);
+	}
+	printf("TEST 1 PASSED - BOUND HEAP MEMORY TO ITS NODE\n");
+
+	// each node frees the other's regions; threads are assigned nodes in turn, so the
+	// thread allocating the third set is on node 0, and the one after it on node 1
+	exchange_regions(second);
+	pthread_create(&thread,NULL,allocate_regions,third);
+	pthread_join(thread,NULL);
+	pthread_create(&thread,NULL,exchange_regions,first);
+	pthread_join(thread,NULL);
+	for(i=3;i<3*COUNT;i++){
+		myfree(first[i]);
+		myfree(second[i]);
+	}
+	for(i=0;i<3*COUNT;i++)myfree(third[i]);
+	printf("TEST 2 PASSED - RETURNED REGIONS TO THEIR NODE\n");
+
+	// regions with mappings of their own are bound as well, aligned ones included
+	char *mapped[2];
+	mapped[0]=(char*)myalloc(1<<20);
+	mapped[1]=(char*)myaligned_alloc(1<<16,1<<20);
+	for(i=0;i<2;i++){
+		if(mapped[i]==NULL)check_failed(3);
+		set(mapped[i],1<<20,i);
+		if(syscall(SYS_get_mempolicy,&mode,&nodes,sizeof(nodes)*8,mapped[i]+(1<<19),MPOL_F_ADDR)!=0)check_failed(3);
+		if(mode!=MPOL_PREFERRED)check_failed(3);
+		myfree(mapped[i]);
+	}
+	printf("TEST 3 PASSED - BOUND MAPPED REGIONS TO THEIR NODE\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
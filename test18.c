@@ -0,0 +1,99 @@
+/* This program grows the heap into its reserved address range, checking that it grows
+   in place without mapping more pages, that space freed across what would have been
+   separate pages coalesces, and that a region at the end of the heap grows in place */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+#define COUNT 1000
+#define SIZE 5000
+#define FREED 100
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats stats;
+	char *regions[COUNT];
+	unsigned long mmaps;
+	size_t peak;
+	int i;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used; large regions stay in the heap
+	setenv("MYALLOC_MMAP_THRESHOLD","67108864",1);
+
+	// many pages worth of regions, laid out back to back
+	regions[0]=(char*)myalloc(SIZE);
+	set(regions[0],SIZE,0);
+	myalloc_stats(&stats);
+	mmaps=stats.mmaps;
+	for(i=1;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+		if(regions[i]!=regions[i-1]+myalloc_usable_size(regions[i-1])+8)check_failed(1);
+	}
+	for(i=0;i<COUNT;i++)check(regions[i],SIZE,i);
+	myalloc_stats(&stats);
+	if(stats.mmaps!=mmaps)check_failed(2);
+	peak=stats.mapped;
+	printf("TEST 1 PASSED - GREW THE HEAP IN PLACE\n");
+
+	// the freed regions span several pages, and make up a single free region
+	int bytes=regions[FREED]-regions[0]-8;
+	for(i=0;i<FREED;i++)myfree(regions[i]);
+	char *p=(char*)myalloc(bytes);
+	if(p!=regions[0])check_failed(3);
+	set(p,bytes,1);
+	for(i=FREED;i<COUNT;i++)check(regions[i],SIZE,i);
+	myfree(p);
+	printf("TEST 2 PASSED - COALESCED ACROSS PAGES\n");
+
+	// emptying the heap gives most of it back, and it grows again without mapping
+	for(i=FREED;i<COUNT;i++)myfree(regions[i]);
+	myalloc_stats(&stats);
+	if(stats.in_use!=0||stats.mapped>peak/2)check_failed(4);
+	for(i=0;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	for(i=0;i<COUNT;i++){
+		check(regions[i],SIZE,i);
+		myfree(regions[i]);
+	}
+	myalloc_stats(&stats);
+	if(stats.mmaps!=mmaps)check_failed(5);
+	printf("TEST 3 PASSED - SHRANK AND REGREW THE HEAP\n");
+
+	// the last region of the heap grows in place
+	p=(char*)myalloc(SIZE);
+	set(p,SIZE,2);
+	char *q=(char*)myrealloc(p,COUNT*SIZE);
+	if(q!=p)check_failed(6);
+	check(q,SIZE,2);
+	set(q,COUNT*SIZE,3);
+	myfree(q);
+	myalloc_stats(&stats);
+	if(stats.mmaps!=mmaps)check_failed(7);
+	printf("TEST 4 PASSED - GREW A REGION IN PLACE\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
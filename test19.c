@@ -0,0 +1,124 @@
+/* This program passes regions from producer threads to consumer threads which free
+   them, checking that regions freed away from their heap wait for that heap to take
+   them back, and that nothing is lost or corrupted on the way */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "myalloc.h"
+
+#define COUNT 1000
+#define SIZE 5000
+#define MESSAGES 100000
+#define SLOTS 64
+#define PAIRS 2
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//sizes cycle through slab slots, cached regions and uncached ones
+int bytes_for(int i){
+	return 1+(i*131)%4000;
+}
+
+char *regions[COUNT];
+
+void *release_all(void *arg){
+	int i;
+	for(i=0;i<COUNT;i++)myfree(regions[i]);
+	return NULL;
+}
+
+//a ring of messages between one producer and one consumer
+typedef struct ring {
+	char *slots[SLOTS];
+	int head,tail;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} ring;
+
+ring rings[PAIRS];
+
+void *produce(void *arg){
+	ring *ring=(struct ring*)arg;
+	int i;
+	for(i=0;i<MESSAGES;i++){
+		char *message=(char*)myalloc(bytes_for(i));
+		set(message,bytes_for(i),i);
+		pthread_mutex_lock(&ring->lock);
+		while(ring->head-ring->tail==SLOTS)pthread_cond_wait(&ring->changed,&ring->lock);
+		ring->slots[ring->head++%SLOTS]=message;
+		pthread_cond_broadcast(&ring->changed);
+		pthread_mutex_unlock(&ring->lock);
+	}
+	return NULL;
+}
+
+void *consume(void *arg){
+	ring *ring=(struct ring*)arg;
+	int i;
+	for(i=0;i<MESSAGES;i++){
+		pthread_mutex_lock(&ring->lock);
+		while(ring->head==ring->tail)pthread_cond_wait(&ring->changed,&ring->lock);
+		char *message=ring->slots[ring->tail++%SLOTS];
+		pthread_cond_broadcast(&ring->changed);
+		pthread_mutex_unlock(&ring->lock);
+		check(message,bytes_for(i),i);
+		myfree(message);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats before,after;
+	pthread_t threads[2*PAIRS];
+	int i;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used; every thread gets a heap of its own
+	setenv("MYALLOC_ARENAS","8",1);
+
+	// regions freed by another thread stay in use until their heap is allocated from
+	for(i=0;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	myalloc_stats(&before);
+	pthread_create(&threads[0],NULL,release_all,NULL);
+	pthread_join(threads[0],NULL);
+	myalloc_stats(&after);
+	if(after.in_use<before.in_use)check_failed(1);
+	char *p=(char*)myalloc(SIZE);
+	myalloc_stats(&after);
+	if(after.in_use>before.in_use-(COUNT-1)*SIZE)check_failed(2);
+	myfree(p);
+	printf("TEST 1 PASSED - TOOK BACK REGIONS FREED BY ANOTHER THREAD\n");
+
+	// producers allocating messages which consumers free
+	for(i=0;i<PAIRS;i++){
+		pthread_mutex_init(&rings[i].lock,NULL);
+		pthread_cond_init(&rings[i].changed,NULL);
+		pthread_create(&threads[2*i],NULL,produce,&rings[i]);
+		pthread_create(&threads[2*i+1],NULL,consume,&rings[i]);
+	}
+	for(i=0;i<2*PAIRS;i++)pthread_join(threads[i],NULL);
+	printf("TEST 2 PASSED - PASSED %i MESSAGES BETWEEN THREADS\n",PAIRS*MESSAGES);
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/* This program allocates and frees regions in batches, checking that batches of larger
+   regions are laid out side by side, and merge back into one free region when freed, and
+   that an empty batch allocates nothing */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "myalloc.h"
+
+#define BATCH 256
+#define ROUNDS 100
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+void *regions[BATCH];
+
+void *release_batch(void *arg){
+	myfree_bulk(regions,BATCH);
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	int sizes[]={1,16,100,500,2000,5000,200000};
+	int counts[]={1,32,BATCH};
+	struct myalloc_stats stats;
+	int i,j,k,round;
+	printf("%s starting\n",argv[0]);
+
+	// batches of every kind of region, freed in order, in reverse, or with gaps
+	for(round=0;round<ROUNDS;round++){
+		for(i=0;i<7;i++){
+			for(j=0;j<3;j++){
+				int count=counts[j];
+				if(sizes[i]>=200000&&count>32)continue;
+				if(myalloc_bulk(sizes[i],count,regions)!=count)check_failed(1);
+				for(k=0;k<count;k++){
+					if((uintptr_t)regions[k]%16!=0)check_failed(2);
+					if(myalloc_usable_size(regions[k])<sizes[i])check_failed(3);
+					set(regions[k],sizes[i],k);
+				}
+				for(k=0;k<count;k++)check(regions[k],sizes[i],k);
+				if(round%3==1){
+					for(k=0;k<count/2;k++){
+						void *swap=regions[k];
+						regions[k]=regions[count-1-k];
+						regions[count-1-k]=swap;
+					}
+				}else if(round%3==2){
+					for(k=0;k<count;k+=2)myfree(regions[k]);
+					for(k=0;k<count;k+=2)regions[k]=NULL;
+				}
+				myfree_bulk(regions,count);
+			}
+		}
+	}
+	printf("TEST 1 PASSED - ALLOCATED AND FREED BATCHES\n");
+
+	// a batch of larger regions lies side by side, and frees back into a single region,
+	// or an emptied page
+	if(myalloc_bulk(2000,BATCH,regions)!=BATCH)check_failed(4);
+	for(k=1;k<BATCH;k++){
+		if((char*)regions[k]!=(char*)regions[k-1]+myalloc_usable_size(regions[k-1])+8)check_failed(5);
+	}
+	myfree_bulk(regions,BATCH);
+	myalloc_stats(&stats);
+	if(stats.largest_free<BATCH*2000&&stats.retained<BATCH*2000)check_failed(6);
+	printf("TEST 2 PASSED - CARVED A BATCH FROM ONE REGION\n");
+
+	// a batch freed by another thread goes back to its own heap
+	if(myalloc_bulk(2000,BATCH,regions)!=BATCH)check_failed(7);
+	for(k=0;k<BATCH;k++)set(regions[k],2000,k);
+	pthread_t thread;
+	pthread_create(&thread,NULL,release_batch,NULL);
+	pthread_join(thread,NULL);
+	void *p=myalloc(2000);
+	myalloc_stats(&stats);
+	if(stats.in_use>=BATCH*2000)check_failed(8);
+	myfree(p);
+	printf("TEST 3 PASSED - FREED A BATCH FROM ANOTHER THREAD\n");
+
+	// an empty batch allocates nothing, and writes nothing around the array
+	void *sentinel[2];
+	size_t before;
+	myalloc_stats(&stats);
+	before=stats.in_use;
+	for(i=0;i<7;i++){
+		sentinel[0]=sentinel[1]=(void*)sentinel;
+		if(myalloc_bulk(sizes[i],0,sentinel+1)!=0)check_failed(9);
+		if(sentinel[0]!=(void*)sentinel||sentinel[1]!=(void*)sentinel)check_failed(10);
+		myfree_bulk(sentinel+1,0);
+	}
+	myalloc_stats(&stats);
+	if(stats.in_use!=before)check_failed(11);
+	printf("TEST 4 PASSED - ALLOCATED AN EMPTY BATCH\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
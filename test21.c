@@ -0,0 +1,89 @@
+/* This program allocates from arenas, checking that their regions are aligned and keep
+   their contents, and that a reset hands the same pages out again without mapping more */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "myalloc.h"
+
+#define COUNT 2000
+#define ROUNDS 10
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//mostly small temporaries, with the odd one larger than a chunk
+int bytes_for(int i){
+	return i%500==499?200000:(i*37)%300;
+}
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats before,after;
+	char *regions[COUNT];
+	char *first=NULL;
+	unsigned long mmaps=0;
+	int i,round;
+	printf("%s starting\n",argv[0]);
+
+	// the heap region allocated below is cached once freed, and stays counted as in use
+	myfree(myalloc(1000));
+	myalloc_stats(&before);
+	myarena *arena=myarena_create();
+	if(arena==NULL)check_failed(1);
+	for(round=0;round<ROUNDS;round++){
+		for(i=0;i<COUNT;i++){
+			regions[i]=(char*)myarena_alloc(arena,bytes_for(i));
+			if(regions[i]==NULL||(uintptr_t)regions[i]%16!=0)check_failed(2);
+			set(regions[i],bytes_for(i),i+round);
+		}
+		for(i=0;i<COUNT;i++)check(regions[i],bytes_for(i),i+round);
+		// the same pages are handed out again from the start
+		if(round==0)first=regions[0];
+		else if(regions[0]!=first)check_failed(3);
+		myalloc_stats(&after);
+		if(round==0)mmaps=after.mmaps;
+		else if(after.mmaps!=mmaps)check_failed(4);
+		myarena_reset(arena);
+	}
+	printf("TEST 1 PASSED - REUSED AN ARENA %i TIMES\n",ROUNDS);
+
+	// arenas next to each other, and regions of the heap, keep apart
+	myarena *other=myarena_create();
+	char *p=(char*)myalloc(1000);
+	char *a=(char*)myarena_alloc(arena,1000);
+	char *b=(char*)myarena_alloc(other,1000);
+	set(p,1000,1);
+	set(a,1000,2);
+	set(b,1000,3);
+	check(p,1000,1);
+	check(a,1000,2);
+	check(b,1000,3);
+	myfree(p);
+	myarena_destroy(other);
+	printf("TEST 2 PASSED - KEPT ARENAS APART\n");
+
+	// destroying an arena gives its pages back
+	myarena_destroy(arena);
+	myalloc_stats(&after);
+	if(after.in_use!=before.in_use)check_failed(5);
+	printf("TEST 3 PASSED - DESTROYED THE ARENAS\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,167 @@
+/* This program checks hardened mode: regions of every kind can be used up to their usable
+   size, while freeing one twice, overrunning one, freeing a pointer never handed out or
+   writing to a freed region aborts the program with a message saying so */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "myalloc.h"
+
+#define SIZES 8
+#define BATCH 32
+#define COUNT 1000
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//the ways of misusing the heap, each run in a child of its own
+enum misuse {DOUBLE_FREE_SMALL,DOUBLE_FREE_LARGE,OVERFLOW_SMALL,OVERFLOW_LARGE,MISALIGNED,INTERIOR,WRITE_AFTER_FREE};
+
+void misuse(enum misuse kind){
+	char *p;
+	char *others[COUNT];
+	int i;
+	switch(kind){
+	case DOUBLE_FREE_SMALL:
+		p=(char*)myalloc(16);
+		myfree(p);
+		myfree(p);
+		break;
+	case DOUBLE_FREE_LARGE:
+		p=(char*)myalloc(5000);
+		myfree(p);
+		myfree(p);
+		break;
+	case OVERFLOW_SMALL:
+		p=(char*)myalloc(100);
+		set(p,myalloc_usable_size(p)+1,1);
+		myfree(p);
+		break;
+	case OVERFLOW_LARGE:
+		p=(char*)myalloc(5000);
+		set(p,myalloc_usable_size(p)+1,1);
+		myfree(p);
+		break;
+	case MISALIGNED:
+		p=(char*)myalloc(5000);
+		myfree(p+8);
+		break;
+	case INTERIOR:
+		p=(char*)myalloc(100);
+		myfree(p+32);
+		break;
+	case WRITE_AFTER_FREE:
+		p=(char*)myalloc(5000);
+		i=myalloc_usable_size(p);
+		myfree(p);
+		set(p,i+8,1);
+		// pushes the region out of quarantine
+		for(i=0;i<COUNT;i++)others[i]=(char*)myalloc(5000);
+		for(i=0;i<COUNT;i++)myfree(others[i]);
+		break;
+	}
+	exit(0);
+}
+
+//run a misuse in a child, checking that it aborts with a message containing what
+void expect_abort(enum misuse kind, const char *what){
+	int fds[2],status;
+	char message[256]={0};
+	if(pipe(fds)!=0)check_failed(100);
+	pid_t pid=fork();
+	if(pid==0){
+		dup2(fds[1],STDERR_FILENO);
+		misuse(kind);
+	}
+	close(fds[1]);
+	if(read(fds[0],message,sizeof(message)-1)<0)check_failed(101);
+	close(fds[0]);
+	waitpid(pid,&status,0);
+	if(!WIFSIGNALED(status)||WTERMSIG(status)!=SIGABRT)check_failed(102+kind);
+	if(strstr(message,"myalloc: ")!=message||strstr(message,what)==NULL)check_failed(110+kind);
+}
+
+int main(int argc, char* argv[]){
+	int sizes[SIZES]={1,16,100,1000,1024,5000,100000,200000};
+	void *regions[BATCH];
+	int i,j;
+	printf("%s starting\n",argv[0]);
+	fflush(stdout);
+	// read when the heaps are first used
+	setenv("MYALLOC_HARDENED","on",1);
+
+	// every region can be filled up to its usable size, however it was allocated
+	for(i=0;i<SIZES;i++){
+		char *p=(char*)myalloc(sizes[i]);
+		char *z=(char*)mycalloc(sizes[i],1);
+		char *a=(char*)myaligned_alloc(256,sizes[i]);
+		if(myalloc_usable_size(p)<sizes[i]||myalloc_usable_size(z)<sizes[i]||myalloc_usable_size(a)<sizes[i])check_failed(1);
+		if((size_t)a%256!=0)check_failed(2);
+		check(z,sizes[i],0);
+		set(p,myalloc_usable_size(p),1);
+		set(z,myalloc_usable_size(z),2);
+		set(a,myalloc_usable_size(a),3);
+		// grown, and shrunk back, with its contents kept
+		p=(char*)myrealloc(p,2*sizes[i]);
+		check(p,sizes[i],1);
+		set(p,myalloc_usable_size(p),4);
+		p=(char*)myrealloc(p,sizes[i]/2+1);
+		check(p,sizes[i]/2+1,4);
+		set(p,myalloc_usable_size(p),5);
+		myfree(p);
+		myfree(z);
+		myfree(a);
+		if(myalloc_bulk(sizes[i],BATCH,regions)!=BATCH)check_failed(3);
+		for(j=0;j<BATCH;j++)set((char*)regions[j],myalloc_usable_size(regions[j]),j);
+		for(j=0;j<BATCH;j++)check((char*)regions[j],myalloc_usable_size(regions[j]),j);
+		myfree_bulk(regions,BATCH);
+	}
+	printf("TEST 1 PASSED - USED REGIONS UP TO THEIR USABLE SIZE\n");
+
+	// a freed region is not handed out again straight away
+	char *p=(char*)myalloc(5000);
+	myfree(p);
+	for(i=0;i<BATCH;i++){
+		regions[i]=myalloc(5000);
+		if(regions[i]==p)check_failed(4);
+	}
+	for(i=0;i<BATCH;i++)myfree(regions[i]);
+	printf("TEST 2 PASSED - QUARANTINED A FREED REGION\n");
+
+	expect_abort(DOUBLE_FREE_SMALL,"double free");
+	expect_abort(DOUBLE_FREE_LARGE,"double free");
+	printf("TEST 3 PASSED - CAUGHT DOUBLE FREES\n");
+
+	expect_abort(OVERFLOW_SMALL,"overflow");
+	expect_abort(OVERFLOW_LARGE,"overflow");
+	printf("TEST 4 PASSED - CAUGHT OVERFLOWS\n");
+
+	expect_abort(MISALIGNED,"invalid pointer");
+	expect_abort(INTERIOR,"invalid pointer");
+	printf("TEST 5 PASSED - CAUGHT INVALID POINTERS\n");
+
+	expect_abort(WRITE_AFTER_FREE,"write after free");
+	printf("TEST 6 PASSED - CAUGHT A WRITE AFTER FREE\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
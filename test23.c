@@ -0,0 +1,133 @@
+/* This program profiles the heap, checking that the profile written counts the sampled
+   regions still in use, and those already freed, against the call sites which allocated
+   them, and that the totals estimated from a sample are close to those allocated */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include "myalloc.h"
+
+#define RATE 4096
+#define KEPT 100
+#define FREED 50
+#define LARGE 65536
+#define SMALLS 5000
+#define SMALL 1000
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+char *kept[KEPT];
+char *smalls[SMALLS];
+char profile[1<<20];
+
+// regions much larger than the rate are always sampled
+__attribute__((noinline)) void allocate_kept(void){
+	int i;
+	for(i=0;i<KEPT;i++){
+		kept[i]=(char*)myalloc(LARGE);
+		set(kept[i],LARGE,i);
+	}
+}
+
+__attribute__((noinline)) void allocate_freed(void){
+	char *regions[FREED];
+	int i;
+	for(i=0;i<FREED;i++)regions[i]=(char*)myalloc(LARGE);
+	for(i=0;i<FREED;i++)myfree(regions[i]);
+}
+
+//read the file at path into profile, returning its length
+int read_profile(const char *path){
+	FILE *file=fopen(path,"r");
+	if(file==NULL)return -1;
+	int length=fread(profile,1,sizeof(profile)-1,file);
+	fclose(file);
+	profile[length]=0;
+	return length;
+}
+
+//e^x, with no maths library to hand
+double exponential(double x){
+	double sum=1,term=1;
+	int i;
+	for(i=1;i<40;i++){
+		term*=x/i;
+		sum+=term;
+	}
+	return sum;
+}
+
+int main(int argc, char* argv[]){
+	char prefix[64],path[96],line[128];
+	unsigned long liveCount,totalCount;
+	size_t liveBytes,totalBytes,rate;
+	int i;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used
+	snprintf(prefix,sizeof(prefix),"/tmp/myalloc-test23-%d",(int)getpid());
+	snprintf(line,sizeof(line),"%d",RATE);
+	setenv("MYALLOC_PROFILE_RATE",line,1);
+	setenv("MYALLOC_PROFILE",prefix,1);
+
+	// the sites allocating regions are told apart, and those freed are counted as such
+	allocate_kept();
+	allocate_freed();
+	snprintf(path,sizeof(path),"%s.dump",prefix);
+	if(myalloc_profile_dump(path)!=0)check_failed(1);
+	if(read_profile(path)<=0)check_failed(2);
+	if(sscanf(profile,"heap profile: %lu: %zu [ %lu: %zu] @ heap_v2/%zu",&liveCount,&liveBytes,&totalCount,&totalBytes,&rate)!=5)check_failed(3);
+	if(rate!=RATE||liveCount!=KEPT||liveBytes!=(size_t)KEPT*LARGE)check_failed(4);
+	if(totalCount<KEPT+FREED||totalBytes<(size_t)(KEPT+FREED)*LARGE)check_failed(5);
+	snprintf(line,sizeof(line),"\n%d: %zu [ %d: %zu] @ 0x",KEPT,(size_t)KEPT*LARGE,KEPT,(size_t)KEPT*LARGE);
+	if(strstr(profile,line)==NULL)check_failed(6);
+	snprintf(line,sizeof(line),"\n0: 0 [ %d: %zu] @ 0x",FREED,(size_t)FREED*LARGE);
+	if(strstr(profile,line)==NULL)check_failed(7);
+	if(strstr(profile,"\nMAPPED_LIBRARIES:\n")==NULL)check_failed(8);
+	printf("TEST 1 PASSED - PROFILED THE REGIONS OF TWO CALL SITES\n");
+
+	// the live bytes of regions too small to always be sampled are estimated from those
+	// that were, as pprof does, each standing for 1 / (1 - e^(-size / rate)) regions
+	for(i=0;i<KEPT;i++){
+		check(kept[i],LARGE,i);
+		myfree(kept[i]);
+	}
+	for(i=0;i<SMALLS;i++)smalls[i]=(char*)myalloc(SMALL);
+	if(myalloc_profile_dump(path)!=0)check_failed(9);
+	if(read_profile(path)<=0)check_failed(10);
+	if(sscanf(profile,"heap profile: %lu: %zu",&liveCount,&liveBytes)!=2)check_failed(11);
+	double estimate=liveBytes/(1-exponential(-(double)SMALL/RATE));
+	if(estimate<0.8*SMALLS*SMALL||estimate>1.2*SMALLS*SMALL)check_failed(12);
+	for(i=0;i<SMALLS;i++)myfree(smalls[i]);
+	printf("TEST 2 PASSED - ESTIMATED %.0f BYTES IN USE OUT OF %d\n",estimate,SMALLS*SMALL);
+
+	// a profile asked for by signal is written at the next sample
+	raise(SIGUSR2);
+	for(i=0;i<4;i++)myfree(myalloc(LARGE));
+	snprintf(line,sizeof(line),"%s.%d.0.heap",prefix,(int)getpid());
+	if(read_profile(line)<=0||strncmp(profile,"heap profile: ",14)!=0)check_failed(13);
+	unlink(line);
+	unlink(path);
+	printf("TEST 3 PASSED - WROTE A PROFILE ON SIGNAL\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/* This program leaves regions in use scattered across the heap, checking that trimming
+   hands the free space between them back to the system, whether asked for or done by the
+   heap as regions are freed, and that the space can be allocated again afterwards */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "myalloc.h"
+
+#define COUNT 2000
+#define SIZE 5000
+#define KEEP 8
+#define RUN 400
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//the bytes of the process resident in memory
+long resident(void){
+	long size,pages;
+	FILE *statm=fopen("/proc/self/statm","r");
+	if(statm==NULL||fscanf(statm,"%ld %ld",&size,&pages)!=2)check_failed(100);
+	fclose(statm);
+	return pages*getpagesize();
+}
+
+char *regions[COUNT];
+
+int main(int argc, char* argv[]){
+	long before,after;
+	size_t released;
+	int i;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used
+	setenv("MYALLOC_TRIM_MS","1",1);
+
+	// a large run of regions freed in the middle of the heap is handed back by the next
+	// free next to it once MYALLOC_TRIM_MS has passed
+	for(i=0;i<RUN+2;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	// a trim may already fire while the run is being freed
+	before=resident();
+	usleep(2000);
+	for(i=0;i<RUN;i++)myfree(regions[i]);
+	usleep(2000);
+	myfree(regions[RUN]);
+	after=resident();
+	if(before-after<RUN*SIZE*3/4)check_failed(1);
+	check(regions[RUN+1],SIZE,RUN+1);
+	myfree(regions[RUN+1]);
+	printf("TEST 1 PASSED - TRIMMED %ld BYTES AS REGIONS WERE FREED\n",before-after);
+
+	// one region in every KEEP kept, the space between them only comes back when asked for
+	for(i=0;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	for(i=0;i<COUNT;i++){
+		if(i%KEEP!=KEEP-1)myfree(regions[i]);
+	}
+	before=resident();
+	released=myalloc_trim();
+	after=resident();
+	// each gap holds at least KEEP-2 whole pages
+	if(released<(size_t)COUNT/KEEP*(KEEP-2)*getpagesize())check_failed(2);
+	if(before-after<(long)released*9/10)check_failed(3);
+	if(myalloc_trim()!=0)check_failed(4);
+	for(i=KEEP-1;i<COUNT;i+=KEEP)check(regions[i],SIZE,i);
+	printf("TEST 2 PASSED - TRIMMED %zu BYTES BETWEEN REGIONS IN USE\n",released);
+
+	// the trimmed space is allocated again as usual
+	for(i=0;i<COUNT;i++){
+		if(i%KEEP==KEEP-1)continue;
+		regions[i]=(char*)mycalloc(SIZE,1);
+		check(regions[i],SIZE,0);
+		set(regions[i],SIZE,i);
+	}
+	for(i=0;i<COUNT;i++)check(regions[i],SIZE,i);
+	for(i=0;i<COUNT;i++)myfree(regions[i]);
+	printf("TEST 3 PASSED - REUSED THE TRIMMED SPACE\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
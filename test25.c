@@ -0,0 +1,210 @@
+/* This program dumps the heaps, checking that the dump accounts for every free region,
+   and for every page in use, full slabs and arena chunks included, tells pages in use
+   from free ones and resident ones from those handed back, and can be taken while
+   another thread keeps allocating */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "myalloc.h"
+#include "heapdump.h"
+
+#define COUNT 2000
+#define SIZE 5000
+#define KEEP 8
+#define SMALLS 10
+#define SMALL 64
+#define DUMPS 20
+#define SLOTS 2000
+#define SLOT 48
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+char *regions[COUNT];
+char *smalls[SMALLS];
+char *slots[SLOTS];
+char dump[1<<24];
+char path[64];
+volatile int stop=0;
+
+//take a dump and read it back, checking that every heap's free regions add up
+void take_dump(void){
+	if(myalloc_heap_dump(path)!=0)check_failed(100);
+	FILE *file=fopen(path,"rb");
+	if(file==NULL)check_failed(101);
+	size_t length=fread(dump,1,sizeof(dump),file);
+	fclose(file);
+	heapdump_header *header=(heapdump_header*)dump;
+	if(length<sizeof(*header)||memcmp(header->magic,HEAPDUMP_MAGIC,8)!=0)check_failed(102);
+	if(header->cell_size!=(uint64_t)getpagesize())check_failed(103);
+	size_t offset=sizeof(*header);
+	uint32_t i;
+	uint64_t j;
+	int class;
+	for(i=0;i<header->heaps;i++){
+		heapdump_heap *heap=(heapdump_heap*)(dump+offset);
+		uint64_t pageFree=0,histogramFree=0;
+		offset+=sizeof(*heap);
+		for(j=0;j<heap->pages;j++){
+			heapdump_page *page=(heapdump_page*)(dump+offset);
+			if(page->cells*header->cell_size!=page->size)check_failed(104);
+			if(page->kind==HEAPDUMP_REGIONS)pageFree+=page->free;
+			offset+=sizeof(*page)+((page->cells+7)&~7);
+			if(offset>length)check_failed(105);
+		}
+		for(class=0;class<64;class++)histogramFree+=heap->free_bytes[class];
+		if(pageFree!=heap->free||histogramFree!=heap->free)check_failed(106);
+	}
+	if(offset!=length)check_failed(107);
+}
+
+//return the cell of the dump's maps covering address, and the kind of page it is in, or
+//-1 if no page of the heaps covers it
+int find_cell(void *address, uint32_t *kind){
+	heapdump_header *header=(heapdump_header*)dump;
+	size_t offset=sizeof(*header);
+	uint32_t i;
+	uint64_t j;
+	for(i=0;i<header->heaps;i++){
+		heapdump_heap *heap=(heapdump_heap*)(dump+offset);
+		offset+=sizeof(*heap);
+		for(j=0;j<heap->pages;j++){
+			heapdump_page *page=(heapdump_page*)(dump+offset);
+			unsigned char *cells=(unsigned char*)(page+1);
+			if((uintptr_t)address>=page->address&&(uintptr_t)address<page->address+page->size){
+				*kind=page->kind;
+				return cells[((uintptr_t)address-page->address)/header->cell_size];
+			}
+			offset+=sizeof(*page)+((page->cells+7)&~7);
+		}
+	}
+	return -1;
+}
+
+//return the bytes in use of the dump's pages of the heap at index less what the heap
+//counts as in use, which is nothing once no thread holds regions in its cache
+long unaccounted(uint32_t index){
+	heapdump_header *header=(heapdump_header*)dump;
+	size_t offset=sizeof(*header);
+	uint32_t i;
+	uint64_t j;
+	for(i=0;i<header->heaps;i++){
+		heapdump_heap *heap=(heapdump_heap*)(dump+offset);
+		long inUse=0;
+		offset+=sizeof(*heap);
+		for(j=0;j<heap->pages;j++){
+			heapdump_page *page=(heapdump_page*)(dump+offset);
+			inUse+=page->in_use;
+			offset+=sizeof(*page)+((page->cells+7)&~7);
+		}
+		if(heap->index==index)return inUse-(long)heap->in_use;
+	}
+	return -1;
+}
+
+void *churn(void *arg){
+	char *held[64]={0};
+	unsigned int i=0;
+	while(!stop){
+		int k=(i*7)%64;
+		if(held[k]!=NULL)myfree(held[k]);
+		held[k]=(char*)myalloc(1+(i*131)%20000);
+		held[k][0]=(char)i;
+		i++;
+	}
+	for(i=0;i<64;i++)myfree(held[i]);
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	uint32_t kind;
+	int i;
+	printf("%s starting\n",argv[0]);
+	// read when the heaps are first used; the allocating thread gets a heap of its own
+	setenv("MYALLOC_ARENAS","2",1);
+	setenv("MYALLOC_TRIM_MS","0",1);
+	snprintf(path,sizeof(path),"/tmp/myalloc-test25-%d.heap",(int)getpid());
+
+	// a few slab slots, and one region in every KEEP kept
+	for(i=0;i<SMALLS;i++)smalls[i]=(char*)myalloc(SMALL);
+	for(i=0;i<COUNT;i++){
+		regions[i]=(char*)myalloc(SIZE);
+		set(regions[i],SIZE,i);
+	}
+	for(i=0;i<COUNT;i++){
+		if(i%KEEP!=KEEP-1)myfree(regions[i]);
+	}
+	take_dump();
+	printf("TEST 1 PASSED - DUMPED THE HEAPS\n");
+
+	// the pages of regions kept are in use, those between them free but resident, unless
+	// they were pages of their own, and unmapped
+	for(i=KEEP-1;i<COUNT;i+=KEEP){
+		if(find_cell(regions[i]+SIZE/2,&kind)<=0||kind!=HEAPDUMP_REGIONS)check_failed(1);
+		if(find_cell(regions[i-KEEP/2]+SIZE/2,&kind)>0)check_failed(2);
+	}
+	if(find_cell(smalls[0],&kind)<=0||kind!=HEAPDUMP_SLAB)check_failed(3);
+	myalloc_trim();
+	take_dump();
+	for(i=KEEP-1;i<COUNT;i+=KEEP){
+		if(find_cell(regions[i]+SIZE/2,&kind)<=0)check_failed(4);
+		int cell=find_cell(regions[i-KEEP/2]+SIZE/2,&kind);
+		if(cell!=HEAPDUMP_NOT_RESIDENT&&cell!=-1)check_failed(5);
+		check(regions[i],SIZE,i);
+	}
+	printf("TEST 2 PASSED - MAPPED PAGES IN USE, FREE AND HANDED BACK\n");
+
+	// full slabs and the chunks of arenas are dumped too, and with them the pages account
+	// for everything the heap has in use
+	for(i=0;i<SLOTS;i++)slots[i]=(char*)myalloc(SLOT);
+	myarena *arena=myarena_create();
+	char *object=(char*)myarena_alloc(arena,SIZE);
+	set(object,SIZE,1);
+	myalloc_trim();
+	take_dump();
+	for(i=0;i<SLOTS;i++){
+		if(find_cell(slots[i],&kind)<=0||kind!=HEAPDUMP_SLAB)check_failed(6);
+	}
+	if(find_cell(object,&kind)<=0||kind!=HEAPDUMP_ARENA)check_failed(7);
+	if(unaccounted(0)!=0)check_failed(8);
+	myarena_destroy(arena);
+	for(i=0;i<SLOTS;i++)myfree(slots[i]);
+	printf("TEST 3 PASSED - DUMPED FULL SLABS AND ARENAS\n");
+
+	// dumps taken while another thread allocates
+	pthread_t thread;
+	pthread_create(&thread,NULL,churn,NULL);
+	for(i=0;i<DUMPS;i++){
+		take_dump();
+		usleep(1000);
+	}
+	stop=1;
+	pthread_join(thread,NULL);
+	printf("TEST 4 PASSED - DUMPED THE HEAPS %i TIMES WHILE ALLOCATING\n",DUMPS);
+
+	for(i=KEEP-1;i<COUNT;i+=KEEP)myfree(regions[i]);
+	for(i=0;i<SMALLS;i++)myfree(smalls[i]);
+	unlink(path);
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
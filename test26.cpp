@@ -0,0 +1,171 @@
+/* This program uses the standard containers with the allocators of myalloc.hpp, checking
+   that they keep their contents, that regions freed with their sizes are reused, that
+   over-aligned types are aligned, and that an arena hands its pages out again after a
+   reset, through both the allocators and the pmr memory resources */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "myalloc.hpp"
+
+#define COUNT 10000
+#define ROUNDS 10
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+struct alignas(64) line {
+	char bytes[64];
+};
+
+template <typename T>
+using vector=std::vector<T,myalloc_cxx::allocator<T>>;
+template <typename K, typename V>
+using map=std::unordered_map<K,V,std::hash<K>,std::equal_to<K>,myalloc_cxx::allocator<std::pair<const K,V>>>;
+
+int main(int argc, char* argv[]){
+	int i,round;
+	printf("%s starting\n",argv[0]);
+	fflush(stdout);
+
+	// containers keep their contents as they grow
+	{
+		vector<int> numbers;
+		map<int,int> squares;
+		std::list<std::string,myalloc_cxx::allocator<std::string>> names;
+		for(i=0;i<COUNT;i++){
+			numbers.push_back(i);
+			squares[i]=i*i;
+			names.push_back(std::to_string(i)+" is a number long enough not to fit in the string");
+		}
+		i=0;
+		for(std::string &name : names){
+			if(numbers[i]!=i||squares[i]!=i*i)check_failed(1);
+			if(name.compare(0,name.find(' '),std::to_string(i))!=0)check_failed(2);
+			i++;
+		}
+		for(i=0;i<COUNT;i+=2)squares.erase(i);
+		if(squares.size()!=COUNT/2||squares.count(2)!=0||squares[3]!=9)check_failed(3);
+	}
+	printf("TEST 1 PASSED - FILLED CONTAINERS WITH %i ELEMENTS\n",COUNT);
+
+	// a region freed with its size is handed out again for the same size
+	for(i=1;i<=1024;i+=37){
+		char *p=(char*)myalloc(i);
+		set(p,i,i);
+		myfree_sized(p,i);
+		char *q=(char*)myalloc(i);
+		if(q!=p)check_failed(4);
+		set(q,i,i+1);
+		check(q,i,i+1);
+		myfree_sized(q,i);
+		q=(char*)mycalloc(i,1);
+		check(q,i,0);
+		myfree_sized(q,i);
+	}
+	// as are larger ones, which are looked up all the same
+	for(i=2000;i<=300000;i*=3){
+		char *p=(char*)myalloc(i);
+		set(p,i,i);
+		myfree_sized(p,i);
+	}
+	myfree_sized(NULL,0);
+	printf("TEST 2 PASSED - FREED REGIONS WITH THEIR SIZES\n");
+
+	// over-aligned types are aligned
+	{
+		vector<line> lines;
+		for(i=0;i<COUNT;i++){
+			lines.emplace_back();
+			set(lines.back().bytes,64,i);
+			if((uintptr_t)lines.data()%64!=0)check_failed(5);
+		}
+		for(i=0;i<COUNT;i++)check(lines[i].bytes,64,i);
+	}
+	printf("TEST 3 PASSED - ALIGNED AN OVER-ALIGNED TYPE\n");
+
+	// an arena's containers start from the same pages after each reset
+	{
+		myalloc_cxx::arena arena;
+		int *first=NULL;
+		for(round=0;round<ROUNDS;round++){
+			{
+				std::vector<int,myalloc_cxx::arena_allocator<int>> numbers(arena);
+				std::vector<line,myalloc_cxx::arena_allocator<line>> lines(arena);
+				numbers.reserve(COUNT);
+				for(i=0;i<COUNT;i++){
+					numbers.push_back(i+round);
+					lines.emplace_back();
+					set(lines.back().bytes,64,i+round);
+				}
+				if((uintptr_t)lines.data()%64!=0)check_failed(6);
+				for(i=0;i<COUNT;i++){
+					if(numbers[i]!=i+round)check_failed(7);
+					check(lines[i].bytes,64,i+round);
+				}
+				if(round==0)first=numbers.data();
+				else if(numbers.data()!=first)check_failed(8);
+			}
+			arena.reset();
+		}
+		myalloc_cxx::arena other;
+		if(myalloc_cxx::arena_allocator<int>(arena)==myalloc_cxx::arena_allocator<long>(other))check_failed(9);
+	}
+	printf("TEST 4 PASSED - REUSED AN ARENA %i TIMES\n",ROUNDS);
+
+	// the same through the memory resources
+	{
+		std::pmr::memory_resource *heap=myalloc_cxx::heap_resource();
+		if(heap!=myalloc_cxx::heap_resource())check_failed(10);
+		std::pmr::vector<line> lines(heap);
+		std::pmr::unordered_map<int,std::pmr::string> names(heap);
+		for(i=0;i<COUNT;i++){
+			lines.emplace_back();
+			set(lines.back().bytes,64,i);
+			names[i]=std::to_string(i)+" is a number long enough not to fit in the string";
+		}
+		if((uintptr_t)lines.data()%64!=0)check_failed(11);
+		for(i=0;i<COUNT;i++){
+			check(lines[i].bytes,64,i);
+			if(names[i].compare(0,names[i].find(' '),std::to_string(i))!=0)check_failed(12);
+		}
+		myalloc_cxx::arena_resource arena;
+		int *first=NULL;
+		for(round=0;round<ROUNDS;round++){
+			{
+				std::pmr::vector<int> numbers(&arena);
+				numbers.reserve(COUNT);
+				for(i=0;i<COUNT;i++)numbers.push_back(i+round);
+				for(i=0;i<COUNT;i++)if(numbers[i]!=i+round)check_failed(13);
+				if(round==0)first=numbers.data();
+				else if(numbers.data()!=first)check_failed(14);
+			}
+			arena.release();
+		}
+		if(arena.is_equal(*heap)||!heap->is_equal(*myalloc_cxx::heap_resource()))check_failed(15);
+	}
+	printf("TEST 5 PASSED - USED THE MEMORY RESOURCES\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/* This program allocates regions on several threads and has each of them freed on
+   another thread, checking that they go back to the heap of the thread that allocated
+   them, which hands their space out again, and that nothing is left in use once the
+   threads are gone */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "myalloc.h"
+
+#define NUMBER_OF_THREADS 8
+#define NUMBER_OF_ALLOCATIONS 128
+#define ROUNDS 50
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		if(mem[i]!=(char)value)check_failed(value);
+	}
+}
+
+void set(char *mem, int bytes, int value){
+	int i;
+	for(i=0;i<bytes;i++){
+		mem[i]=(char)value;
+	}
+}
+
+//every other size is too large for the thread caches, so it is freed into its heap
+int bytes_for(int i){
+	return i%2==0 ? 16+(i*37)%1000 : 2000+(i*97)%6000;
+}
+
+char *allocated[NUMBER_OF_THREADS][NUMBER_OF_ALLOCATIONS];
+pthread_barrier_t barrier;
+struct myalloc_stats held;
+
+//wait for the other threads, and have one of them take the statistics
+int wait_and_count(struct myalloc_stats *stats){
+	if(pthread_barrier_wait(&barrier)==PTHREAD_BARRIER_SERIAL_THREAD){
+		myalloc_stats(stats);
+		return 1;
+	}
+	return 0;
+}
+
+void *worker(void *arg){
+	int id=(int)(long)arg;
+	int other=(id+1)%NUMBER_OF_THREADS;
+	struct myalloc_stats stats;
+	int round,i;
+	for(round=0;round<ROUNDS;round++){
+		for(i=0;i<NUMBER_OF_ALLOCATIONS;i++){
+			allocated[id][i]=(char*)myalloc(bytes_for(i));
+			set(allocated[id][i],bytes_for(i),id+i);
+		}
+		pthread_barrier_wait(&barrier);
+		//free the regions allocated by the next thread
+		for(i=0;i<NUMBER_OF_ALLOCATIONS;i++){
+			check(allocated[other][i],bytes_for(i),other+i);
+			myfree(allocated[other][i]);
+		}
+		pthread_barrier_wait(&barrier);
+	}
+
+	//regions too large for the caches, freed by the next thread, wait for their own heap
+	//counted as in use, and are handed out by it again rather than the heap growing
+	for(i=1;i<NUMBER_OF_ALLOCATIONS;i+=2)allocated[id][i]=(char*)myalloc(bytes_for(i));
+	wait_and_count(&held);
+	pthread_barrier_wait(&barrier);
+	for(i=1;i<NUMBER_OF_ALLOCATIONS;i+=2)myfree(allocated[other][i]);
+	if(wait_and_count(&stats)&&stats.in_use!=held.in_use)check_failed(1);
+	pthread_barrier_wait(&barrier);
+	for(i=1;i<NUMBER_OF_ALLOCATIONS;i+=2)allocated[id][i]=(char*)myalloc(bytes_for(i));
+	if(wait_and_count(&stats)&&(stats.in_use!=held.in_use||stats.mapped!=held.mapped))check_failed(2);
+	pthread_barrier_wait(&barrier);
+	for(i=1;i<NUMBER_OF_ALLOCATIONS;i+=2)myfree(allocated[id][i]);
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	pthread_t threads[NUMBER_OF_THREADS];
+	struct myalloc_stats before,after;
+	char heaps[16];
+	long i;
+	printf("%s starting\n",argv[0]);
+	// a heap of its own for every thread, with room for them to be split between NUMA
+	// nodes, and freed regions released at once rather than quarantined in hardened mode
+	snprintf(heaps,sizeof(heaps),"%d",2*(NUMBER_OF_THREADS+1));
+	setenv("MYALLOC_ARENAS",heaps,1);
+	setenv("MYALLOC_QUARANTINE","0",1);
+	myalloc_trim();
+	myalloc_stats(&before);
+	pthread_barrier_init(&barrier,NULL,NUMBER_OF_THREADS);
+
+	for(i=0;i<NUMBER_OF_THREADS;i++){
+		pthread_create(&threads[i],NULL,worker,(void*)i);
+	}
+	for(i=0;i<NUMBER_OF_THREADS;i++){
+		pthread_join(threads[i],NULL);
+	}
+	printf("TEST 1 PASSED - %i THREADS FREED EACH OTHER'S REGIONS FOR %i ROUNDS\n",NUMBER_OF_THREADS,ROUNDS);
+	printf("TEST 2 PASSED - FREED REGIONS WENT BACK TO THEIR OWN HEAPS\n");
+
+	// the exited threads' caches went back to the heaps, leaving nothing in use once the
+	// regions handed back to heaps nobody allocates from any more are released, which
+	// trimming does
+	myalloc_trim();
+	myalloc_stats(&after);
+	if(after.in_use!=before.in_use)check_failed(3);
+	printf("TEST 3 PASSED - NOTHING LEFT IN USE\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -13,5 +13,5 @@ int main() {
     myfree(c);
     myfree(b);
     myfree(a);
-    //should result in two deallocations, leaving the root page behind
+    //should result in two pages being retained for reuse, leaving the root page behind
 }
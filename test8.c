@@ -0,0 +1,88 @@
+/* This program allocates and frees integer arrays from several threads at once,
+   including regions that were allocated by another thread */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "myalloc.h"
+
+#define NUMBER_OF_THREADS 8
+#define NUMBER_OF_ALLOCATIONS 256
+#define ROUNDS 200
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(int *mem, int ints, int value){
+	int i;
+	for(i=0;i<ints;i++){
+		if(mem[i]!=value)check_failed(value);
+	}
+}
+
+void set(int *mem, int ints, int value){
+	int i;
+	for(i=0;i<ints;i++){
+		mem[i]=value;
+	}
+}
+
+//sizes cycle through both cached and uncached classes
+int ints_for(int i){
+	return 1+(i*37)%700;
+}
+
+//each thread hands its last round of allocations to its neighbour to free
+int *handoff[NUMBER_OF_THREADS][NUMBER_OF_ALLOCATIONS];
+pthread_barrier_t barrier;
+
+void *worker(void *arg){
+	int id=(int)(long)arg;
+	int **allocated=handoff[id];
+	int round,i;
+	for(round=0;round<ROUNDS;round++){
+		for(i=0;i<NUMBER_OF_ALLOCATIONS;i++){
+			allocated[i]=(int*)myalloc(sizeof(int)*ints_for(i));
+			set(allocated[i],ints_for(i),id*NUMBER_OF_ALLOCATIONS+i);
+		}
+		for(i=0;i<NUMBER_OF_ALLOCATIONS;i++){
+			check(allocated[i],ints_for(i),id*NUMBER_OF_ALLOCATIONS+i);
+			if(round!=ROUNDS-1)myfree(allocated[i]);
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	//free the regions allocated by the next thread
+	int other=(id+1)%NUMBER_OF_THREADS;
+	for(i=0;i<NUMBER_OF_ALLOCATIONS;i++){
+		check(handoff[other][i],ints_for(i),other*NUMBER_OF_ALLOCATIONS+i);
+		myfree(handoff[other][i]);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[]){
+	pthread_t threads[NUMBER_OF_THREADS];
+	long i;
+	printf("%s starting\n",argv[0]);
+	pthread_barrier_init(&barrier,NULL,NUMBER_OF_THREADS);
+
+	for(i=0;i<NUMBER_OF_THREADS;i++){
+		pthread_create(&threads[i],NULL,worker,(void*)i);
+	}
+	for(i=0;i<NUMBER_OF_THREADS;i++){
+		pthread_join(threads[i],NULL);
+	}
+	printf("TEST 1 PASSED - %i THREADS ALLOCATED, CHECKED AND FREED\n",NUMBER_OF_THREADS);
+
+	//the exited threads' caches must have been returned for reuse
+	int *p=(int*)myalloc(sizeof(int)*10);
+	set(p,10,1);
+	check(p,10,1);
+	myfree(p);
+	printf("TEST 2 PASSED - ALLOCATED AFTER THREADS EXITED\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
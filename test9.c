@@ -0,0 +1,114 @@
+/* This program grows and shrinks regions with myrealloc, across the small, block and
+   directly mapped sizes, checking that their contents survive, and fills slabs with
+   small regions, checking that every slot is found in its slab and reused, and that
+   emptied slabs are kept for reuse */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "myalloc.h"
+
+//enough slots of a slab's size class to fill several slabs, huge pages included
+#define SLOTS 100000
+#define SLOT_INTS 12
+
+void check_failed(int val){
+	fprintf(stderr, "Check failed for region with value %i.",val);
+	exit(-1);
+}
+
+void check(int *mem, int ints, int value){
+	int i;
+	for(i=0;i<ints;i++){
+		if(mem[i]!=value+i)check_failed(value);
+	}
+}
+
+void set(int *mem, int ints, int value){
+	int i;
+	for(i=0;i<ints;i++){
+		mem[i]=value+i;
+	}
+}
+
+int *slots[SLOTS];
+
+int main(int argc, char* argv[]){
+	struct myalloc_stats before,filled,emptied,refilled;
+	int i;
+	printf("%s starting\n",argv[0]);
+
+	// grow a small region step by step, well past the mmap threshold
+	int ints=4;
+	int *p=(int*)myalloc(sizeof(int)*ints);
+	set(p,ints,1);
+	while(ints<(64<<20)/(int)sizeof(int)){
+		p=(int*)myrealloc(p,sizeof(int)*ints*4);
+		check(p,ints,1);
+		ints*=4;
+		set(p,ints,1);
+	}
+	printf("TEST 1 PASSED - GREW TO %i BYTES\n",ints*(int)sizeof(int));
+
+	// shrink it back down again
+	while(ints>4){
+		ints/=4;
+		p=(int*)myrealloc(p,sizeof(int)*ints);
+		check(p,ints,1);
+	}
+	printf("TEST 2 PASSED - SHRANK TO %i BYTES\n",ints*(int)sizeof(int));
+
+	// a huge region, freed directly
+	int *q=(int*)myalloc(sizeof(int)*1000000);
+	set(q,1000000,2);
+	check(q,1000000,2);
+	myfree(q);
+	printf("TEST 3 PASSED - ALLOCATED AND FREED A HUGE REGION\n");
+
+	// NULL and zero sizes
+	int *r=(int*)myrealloc(NULL,sizeof(int)*10);
+	set(r,10,3);
+	check(r,10,3);
+	if(myrealloc(r,0)!=NULL)check_failed(3);
+	myfree(p);
+	printf("TEST 4 PASSED - REALLOCATED NULL AND TO ZERO\n");
+
+	// slots all over their slabs are found in them, as a slot taken for a headed region
+	// would have its neighbour's contents read as its header
+	myalloc_stats(&before);
+	for(i=0;i<SLOTS;i++){
+		slots[i]=(int*)myalloc(sizeof(int)*SLOT_INTS);
+		if((uintptr_t)slots[i]%16!=0)check_failed(4);
+		set(slots[i],SLOT_INTS,i);
+	}
+	for(i=0;i<SLOTS;i++){
+		if(myalloc_usable_size(slots[i])!=myalloc_usable_size(slots[0]))check_failed(5);
+		if(myalloc_usable_size(slots[i])<sizeof(int)*SLOT_INTS)check_failed(6);
+		check(slots[i],SLOT_INTS,i);
+	}
+	myalloc_stats(&filled);
+	if(filled.mapped<=before.mapped)check_failed(7);
+	printf("TEST 5 PASSED - FILLED SLABS WITH %i SLOTS\n",SLOTS);
+
+	// emptied slabs are kept for reuse, up to the heap's limit, and their pages handed
+	// out again before any more are mapped
+	for(i=0;i<SLOTS;i++)myfree(slots[i]);
+	myalloc_stats(&emptied);
+	if(emptied.retained<=before.retained)check_failed(8);
+	if(emptied.mapped>filled.mapped)check_failed(9);
+	for(i=0;i<SLOTS;i++){
+		slots[i]=(int*)myalloc(sizeof(int)*SLOT_INTS);
+		set(slots[i],SLOT_INTS,i);
+	}
+	myalloc_stats(&refilled);
+	if(refilled.retained>=emptied.retained)check_failed(10);
+	if(refilled.mmaps-emptied.mmaps>=filled.mmaps-before.mmaps)check_failed(11);
+	for(i=0;i<SLOTS;i++){
+		check(slots[i],SLOT_INTS,i);
+		myfree(slots[i]);
+	}
+	printf("TEST 6 PASSED - REUSED EMPTIED SLABS\n");
+
+	printf("%s complete\n",argv[0]);
+	return 0;
+}
@@ -0,0 +1,267 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include "trace.h"
+
+/*
+ * Reads traces recorded with MYALLOC_TRACE back for replaying, see trace.h, for both the
+ * replay tool and the benchmark's replay workload.
+ *
+ * The events are put in the order they happened by their times, and each region is
+ * given an object id for as long as it is live, so that a replay only has to keep an
+ * array of the regions it made. Releases of regions the trace does not show being
+ * allocated, as when the trace was started late or events were dropped, are skipped; a
+ * region whose address is allocated again without its release in the trace is released
+ * first.
+ */
+
+static trace_event *EVENTS;
+
+//order events by time, then by thread and their place in the trace, which keeps each
+//thread's events in order even if the clock did not advance between them
+static int event_compare(const void *a, const void *b) {
+    const trace_event *x = &EVENTS[*(const size_t*)a];
+    const trace_event *y = &EVENTS[*(const size_t*)b];
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+    if (x->thread != y->thread)
+        return x->thread < y->thread ? -1 : 1;
+    return *(const size_t*)a < *(const size_t*)b ? -1 : 1;
+}
+
+/*--- OBJECT TABLE ---*/
+
+/*
+ * The regions live at a point of the trace, by the address they were recorded with: an
+ * open-addressing hash table, with deletions shifting later entries of a run back so that
+ * no tombstones are needed.
+ */
+typedef struct entry {
+    //recorded address, 0 for an empty slot
+    uint64_t address;
+    unsigned int id;
+} entry;
+
+static entry *TABLE;
+static size_t TABLE_SIZE;
+static size_t TABLE_COUNT;
+
+//object ids that have been freed, for reuse so that ids stay small
+static unsigned int *IDS;
+static size_t ID_COUNT;
+static size_t ID_CAPACITY;
+static unsigned int NEXT_ID;
+
+static size_t table_slot(uint64_t address) {
+    return (address >> 4) * 0x9e3779b97f4a7c15ULL >> 7 & (TABLE_SIZE - 1);
+}
+
+//return the entry for an address, or NULL if it is not live
+static entry *table_find(uint64_t address) {
+    if (TABLE_SIZE == 0)
+        return NULL;
+    for (size_t i = table_slot(address); TABLE[i].address != 0; i = (i + 1) & (TABLE_SIZE - 1))
+        if (TABLE[i].address == address)
+            return &TABLE[i];
+    return NULL;
+}
+
+//add an entry for an address that is not live, and return it
+static entry *table_insert(uint64_t address) {
+    if (2 * (TABLE_COUNT + 1) > TABLE_SIZE) {
+        entry *old = TABLE;
+        size_t oldSize = TABLE_SIZE;
+        TABLE_SIZE = TABLE_SIZE == 0 ? 1024 : 2 * TABLE_SIZE;
+        TABLE = calloc(TABLE_SIZE, sizeof(entry));
+        for (size_t i = 0; i < oldSize; i++) {
+            if (old[i].address != 0) {
+                size_t j = table_slot(old[i].address);
+                while (TABLE[j].address != 0)
+                    j = (j + 1) & (TABLE_SIZE - 1);
+                TABLE[j] = old[i];
+            }
+        }
+        free(old);
+    }
+    size_t i = table_slot(address);
+    while (TABLE[i].address != 0)
+        i = (i + 1) & (TABLE_SIZE - 1);
+    TABLE[i].address = address;
+    TABLE_COUNT++;
+    return &TABLE[i];
+}
+
+//remove an entry, moving back the entries after it that were displaced past its slot
+static void table_remove(entry *removed) {
+    size_t hole = removed - TABLE;
+    for (size_t i = (hole + 1) & (TABLE_SIZE - 1); TABLE[i].address != 0; i = (i + 1) & (TABLE_SIZE - 1)) {
+        size_t home = table_slot(TABLE[i].address);
+        //move it unless its home lies cyclically in (hole, i]
+        if (((i - home) & (TABLE_SIZE - 1)) >= ((i - hole) & (TABLE_SIZE - 1))) {
+            TABLE[hole] = TABLE[i];
+            hole = i;
+        }
+    }
+    TABLE[hole].address = 0;
+    TABLE_COUNT--;
+}
+
+/*--- OPERATIONS ---*/
+
+//append an operation to a trace, return false if out of memory
+static bool op_add(trace_ops *trace, size_t *capacity, uint32_t kind, uint32_t id, uint64_t size, uint64_t alignment) {
+    if (trace->count == *capacity) {
+        *capacity = *capacity == 0 ? 1024 : 2 * *capacity;
+        trace_op *ops = realloc(trace->ops, *capacity * sizeof(trace_op));
+        if (ops == NULL)
+            return false;
+        trace->ops = ops;
+    }
+    trace->ops[trace->count++] = (trace_op){kind, id, size, alignment};
+    return true;
+}
+
+//give a newly live address an object id, releasing the object that was live there, if
+//any, as its release was lost; return the id, or -1 if out of memory
+static long object_add(trace_ops *trace, size_t *capacity, uint64_t address) {
+    entry *entry = table_find(address);
+    if (entry != NULL) {
+        if (!op_add(trace, capacity, TRACE_FREE, entry->id, 0, 0))
+            return -1;
+        return entry->id;
+    }
+    entry = table_insert(address);
+    entry->id = ID_COUNT > 0 ? IDS[--ID_COUNT] : NEXT_ID++;
+    return entry->id;
+}
+
+//release the object live at an address, return 1 if it was, 0 if it is not live, and -1
+//if out of memory
+static int object_free(trace_ops *trace, size_t *capacity, uint64_t address) {
+    entry *entry = table_find(address);
+    if (entry == NULL)
+        return 0;
+    if (ID_COUNT == ID_CAPACITY) {
+        ID_CAPACITY = ID_CAPACITY == 0 ? 1024 : 2 * ID_CAPACITY;
+        unsigned int *ids = realloc(IDS, ID_CAPACITY * sizeof(unsigned int));
+        if (ids == NULL)
+            return -1;
+        IDS = ids;
+    }
+    if (!op_add(trace, capacity, TRACE_FREE, entry->id, 0, 0))
+        return -1;
+    IDS[ID_COUNT++] = entry->id;
+    table_remove(entry);
+    return 1;
+}
+
+//add the operations of one event to a trace, return 1 if it was added, 0 if it was
+//skipped, and -1 if out of memory
+static int event_add(trace_ops *trace, size_t *capacity, const trace_event *event) {
+    long id;
+    switch (event->kind) {
+    case TRACE_ALLOC:
+    case TRACE_CALLOC:
+    case TRACE_ALIGNED:
+        id = object_add(trace, capacity, event->address);
+        if (id < 0)
+            return -1;
+        return op_add(trace, capacity, event->kind, id, event->size, event->kind == TRACE_ALIGNED ? event->previous : 0) ? 1 : -1;
+    case TRACE_FREE:
+        return object_free(trace, capacity, event->address);
+    case TRACE_REALLOC:
+        //resizing nothing allocates, under an id whose region is still NULL
+        if (event->previous == 0) {
+            id = object_add(trace, capacity, event->address);
+            if (id < 0)
+                return -1;
+            return op_add(trace, capacity, TRACE_REALLOC, id, event->size, 0) ? 1 : -1;
+        }
+        if (event->size == 0)
+            return object_free(trace, capacity, event->previous);
+        entry *entry = table_find(event->previous);
+        if (entry == NULL)
+            return 0;
+        id = entry->id;
+        if (!op_add(trace, capacity, TRACE_REALLOC, id, event->size, 0))
+            return -1;
+        //the object moves with its region, releasing any left at its new address
+        if (event->address != event->previous) {
+            table_remove(entry);
+            if (object_free(trace, capacity, event->address) < 0)
+                return -1;
+            table_insert(event->address)->id = id;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*--- READING ---*/
+
+int trace_read(const char *path, trace_ops *trace) {
+    memset(trace, 0, sizeof(*trace));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(trace_header)) {
+        close(fd);
+        return -1;
+    }
+    void *file = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        return -1;
+    trace_header *header = file;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0) {
+        munmap(file, status.st_size);
+        return -1;
+    }
+    //a trace cut short by its process dying keeps the events it has room for
+    EVENTS = (trace_event*)(header + 1);
+    size_t events = (status.st_size - sizeof(trace_header)) / sizeof(trace_event);
+    if (header->events < events)
+        events = header->events;
+    trace->dropped = header->dropped;
+
+    size_t *order = malloc(events * sizeof(size_t) + 1);
+    bool read = order != NULL;
+    for (size_t i = 0; read && i < events; i++)
+        order[i] = i;
+    if (read)
+        qsort(order, events, sizeof(size_t), event_compare);
+    size_t capacity = 0;
+    for (size_t i = 0; read && i < events; i++) {
+        int added = event_add(trace, &capacity, &EVENTS[order[i]]);
+        if (added == 0)
+            trace->skipped++;
+        read = added >= 0;
+    }
+    trace->ids = NEXT_ID;
+
+    free(order);
+    free(TABLE);
+    free(IDS);
+    TABLE = NULL;
+    TABLE_SIZE = TABLE_COUNT = 0;
+    IDS = NULL;
+    ID_COUNT = ID_CAPACITY = 0;
+    NEXT_ID = 0;
+    munmap(file, status.st_size);
+    if (!read) {
+        trace_discard(trace);
+        return -1;
+    }
+    return 0;
+}
+
+void trace_discard(trace_ops *trace) {
+    free(trace->ops);
+    memset(trace, 0, sizeof(*trace));
+}
@@ -0,0 +1,73 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/*	The format of the allocation traces written when MYALLOC_TRACE names a file, and
+	read back by trace_read, for the replay tool and the benchmark's replay workload. A
+	trace is a trace_header followed by its events, each thread's in the order they
+	happened, with the threads' events interleaved in batches; sorting them by time
+	gives the order across threads. */
+
+#define TRACE_MAGIC "MYTRACE1"
+
+/*	The kinds of event: an allocation with myalloc, mycalloc or myaligned_alloc, a
+	release with myfree, and a resize with myrealloc. */
+#define TRACE_ALLOC 1
+#define TRACE_CALLOC 2
+#define TRACE_ALIGNED 3
+#define TRACE_FREE 4
+#define TRACE_REALLOC 5
+
+typedef struct trace_header {
+	char magic[8];
+	/*	number of events written after the header */
+	uint64_t events;
+	/*	number of events that did not fit in the file, and were lost */
+	uint64_t dropped;
+} trace_header;
+
+typedef struct trace_event {
+	/*	nanoseconds since tracing started */
+	uint64_t time;
+	/*	the region allocated, freed, or returned by myrealloc */
+	uint64_t address;
+	/*	the region passed to myrealloc, or the alignment passed to myaligned_alloc */
+	uint64_t previous;
+	/*	the size requested, in total for mycalloc; 0 for a release */
+	uint64_t size;
+	/*	the tracing thread, numbered from 0 in the order threads first allocated */
+	uint32_t thread;
+	uint32_t kind;
+} trace_event;
+
+/*	A trace read back for replaying, by trace_read in trace.c: its events in the order
+	they happened across threads, as operations on objects. An object id names a region
+	from its allocation to its release, and is reused by a later one once released, so
+	that ids stay small. */
+typedef struct trace_op {
+	/*	one of the kinds of event; a resize of an object whose region is still NULL
+		allocates it, as myrealloc(NULL, size) does */
+	uint32_t kind;
+	uint32_t id;
+	/*	the size requested, in total for TRACE_CALLOC, and the alignment requested for
+		TRACE_ALIGNED */
+	uint64_t size;
+	uint64_t alignment;
+} trace_op;
+
+typedef struct trace_ops {
+	trace_op *ops;
+	size_t count;
+	/*	object ids are all below this */
+	uint32_t ids;
+	/*	events skipped as they released regions the trace does not show allocated, as
+		when it was started late, and events lost while tracing */
+	size_t skipped;
+	uint64_t dropped;
+} trace_ops;
+
+/*	Read the trace at 'path' into 'trace'. On success 0 is returned; -1 is returned if
+	the file cannot be read, is not a trace, or memory runs out. */
+int trace_read(const char *path, trace_ops *trace);
+
+/*	Free the operations of a trace read by trace_read. */
+void trace_discard(trace_ops *trace);